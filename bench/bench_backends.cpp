@@ -0,0 +1,447 @@
+#include "cpu_compute.h"
+#include "gpu_compute.h"
+#include "hybrid_compute.h"
+#include "numa.h"
+#include "simd_transform.h"
+#include <benchmark/benchmark.h>
+#include <algorithm>
+#include <chrono>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <string>
+#include <thread>
+#include <vector>
+
+// Backend sweep (size x threads x backend), a GPU breakdown into upload,
+// dispatch and download, GPU startup with a cold or warm program cache,
+// f32 vs 16-bit storage, and batched vs one-call-per-array small jobs.
+// Every benchmark uses manual timing so it can keep
+// per-iteration samples: Google Benchmark only aggregates across
+// repetitions, and the p50/p99 counters below need the distribution within
+// one run.
+//
+//   ./PS_bench --benchmark_filter=Backend --benchmark_out=results.json --benchmark_out_format=json
+//
+// The JSON context records the GL renderer, SIMD level and topology, so
+// results from llvmpipe and from real hardware are told apart when diffed
+// (e.g. with Google Benchmark's tools/compare.py).
+
+namespace {
+
+using Clock = std::chrono::steady_clock;
+
+double secondsSince(Clock::time_point start) {
+    return std::chrono::duration<double>(Clock::now() - start).count();
+}
+
+class Latencies {
+public:
+    // Records a sample and makes it the iteration's time.
+    void add(benchmark::State& state, double seconds) {
+        state.SetIterationTime(seconds);
+        record(seconds);
+    }
+    void record(double seconds) { samples.push_back(seconds); }
+
+    // p50/p99 per iteration plus throughput counters for `elements` values
+    // of element_bytes each.
+    void report(benchmark::State& state, size_t elements, size_t element_bytes = sizeof(float)) {
+        state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(elements));
+        state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(elements * element_bytes));
+        reportPercentiles(state, "");
+    }
+
+    void reportPercentiles(benchmark::State& state, const std::string& prefix) {
+        if (samples.empty()) return;
+        std::sort(samples.begin(), samples.end());
+        state.counters[prefix + "p50_ms"] = percentile(0.50) * 1e3;
+        state.counters[prefix + "p99_ms"] = percentile(0.99) * 1e3;
+    }
+
+private:
+    double percentile(double p) const {
+        size_t i = static_cast<size_t>(p * (samples.size() - 1) + 0.5);
+        return samples[std::min(i, samples.size() - 1)];
+    }
+
+    std::vector<double> samples;
+};
+
+// One GL context for the whole run; null (with the reason) when none can be
+// created, in which case the GPU benchmarks skip. Recreated on the next
+// call after releaseSharedGpus().
+std::unique_ptr<ComputeGPU> g_shared_gpu;
+std::unique_ptr<ComputeHybrid> g_shared_hybrid;
+bool g_shared_gpu_tried = false;
+std::string g_shared_gpu_failure;
+
+ComputeGPU* sharedGpu(std::string* error = nullptr) {
+    if (!g_shared_gpu_tried) {
+        g_shared_gpu_tried = true;
+        auto g = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
+        try {
+            g->init("shaders/compute_shader.glsl");
+            g_shared_gpu = std::move(g);
+        } catch (const std::exception& e) {
+            g_shared_gpu_failure = e.what();
+        }
+    }
+    if (error) *error = g_shared_gpu_failure;
+    return g_shared_gpu.get();
+}
+
+ComputeHybrid& sharedHybrid() {
+    if (!g_shared_hybrid) g_shared_hybrid = std::make_unique<ComputeHybrid>("shaders/compute_shader.glsl");
+    return *g_shared_hybrid;
+}
+
+// Drops the shared instances, and with them the process's GPU device.
+void releaseSharedGpus() {
+    g_shared_gpu.reset();
+    g_shared_hybrid.reset();
+    g_shared_gpu_tried = false;
+}
+
+std::shared_ptr<ThreadPool> poolWithThreads(unsigned threads) {
+    static std::map<unsigned, std::shared_ptr<ThreadPool>> pools;
+    auto& pool = pools[threads];
+    if (!pool) pool = std::make_shared<ThreadPool>(threads);
+    return pool;
+}
+
+void sizeSweep(benchmark::internal::Benchmark* b) {
+    for (int64_t n : {1 << 16, 1 << 20, 1 << 24}) b->Arg(n);
+}
+
+// Size x Storage.
+void storageSweep(benchmark::internal::Benchmark* b) {
+    for (int64_t n : {1 << 20, 1 << 24})
+        for (Storage storage : {Storage::F32, Storage::F16, Storage::BF16}) b->Args({n, static_cast<int64_t>(storage)});
+}
+
+// Elements per array x (0: run() per array, 1: one runBatch()).
+void batchSweep(benchmark::internal::Benchmark* b) {
+    for (int64_t n : {256, 4096})
+        for (int64_t batched : {0, 1}) b->Args({n, batched});
+}
+
+void sizeAndThreadSweep(benchmark::internal::Benchmark* b) {
+    unsigned hw = std::max(1u, std::thread::hardware_concurrency());
+    std::vector<int64_t> threads;
+    for (unsigned t = 1; t < hw; t *= 2) threads.push_back(t);
+    threads.push_back(hw);
+    for (int64_t n : {1 << 16, 1 << 20, 1 << 24})
+        for (int64_t t : threads) b->Args({n, t});
+}
+
+}
+
+static void BM_Backend_CPU(benchmark::State& state) {
+    size_t n = static_cast<size_t>(state.range(0));
+    ComputeCPU compute(poolWithThreads(static_cast<unsigned>(state.range(1))));
+    std::vector<float> data(n, 64.0f);
+    Latencies latencies;
+
+    compute.process(data);  // warm up: page faults, pool wake-up
+    for (auto _ : state) {
+        auto start = Clock::now();
+        compute.process(data);
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, n);
+    state.SetLabel("cpu");
+}
+
+// Upload + dispatch + download, as ComputeGPU::process does it.
+static void BM_Backend_GPU(benchmark::State& state) {
+    std::string error;
+    ComputeGPU* gpu = sharedGpu(&error);
+    if (!gpu) {
+        state.SkipWithError(("no GL context: " + error).c_str());
+        return;
+    }
+    size_t n = static_cast<size_t>(state.range(0));
+    std::vector<float> data(n, 64.0f);
+    Latencies latencies;
+
+    gpu->process(data);
+    for (auto _ : state) {
+        auto start = Clock::now();
+        gpu->process(data);
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, n);
+    state.SetLabel("gpu");
+}
+
+static void BM_Backend_Hybrid(benchmark::State& state) {
+    ComputeHybrid& hybrid = sharedHybrid();
+    size_t n = static_cast<size_t>(state.range(0));
+    std::vector<float> data(n, 64.0f);
+    Latencies latencies;
+
+    hybrid.process(data);
+    for (auto _ : state) {
+        auto start = Clock::now();
+        hybrid.process(data);
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, n);
+    state.counters["gpu_fraction"] = hybrid.gpuFraction();
+    state.SetLabel(hybrid.gpuAvailable() ? "hybrid" : "hybrid (cpu only)");
+}
+
+namespace {
+
+// process() over the same values stored as range(1) = Storage.
+void runStorage(benchmark::State& state, ICompute& compute, const std::string& label) {
+    static const char* names[] = {"f32", "f16", "bf16"};
+    size_t n = static_cast<size_t>(state.range(0));
+    Storage storage = static_cast<Storage>(state.range(1));
+    std::vector<float> f32(storage == Storage::F32 ? n : 0, 64.0f);
+    std::vector<Half> f16(storage == Storage::F16 ? n : 0, toHalf(64.0f));
+    std::vector<BFloat16> bf16(storage == Storage::BF16 ? n : 0, toBFloat16(64.0f));
+    auto once = [&] {
+        if (storage == Storage::F16) compute.process(HalfSpan(f16));
+        else if (storage == Storage::BF16) compute.process(BFloat16Span(bf16));
+        else compute.process(FloatSpan(f32));
+    };
+    Latencies latencies;
+
+    once();
+    for (auto _ : state) {
+        auto start = Clock::now();
+        once();
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, n, storage == Storage::F32 ? sizeof(float) : sizeof(Half));
+    state.SetLabel(label + " " + names[state.range(1)]);
+}
+
+// A sum over each of 1024 arrays of range(0) elements.
+void runBatches(benchmark::State& state, ICompute& compute, const std::string& label) {
+    constexpr size_t kArrays = 1024;
+    size_t n = static_cast<size_t>(state.range(0));
+    bool batched = state.range(1) != 0;
+    std::vector<std::vector<float>> arrays(kArrays, std::vector<float>(n, 1.0f));
+    std::vector<FloatSpan> spans(arrays.begin(), arrays.end());
+    kernels::Kernel sum = kernels::makeReduce(kernels::Reduce::Sum);
+    auto once = [&] {
+        if (batched) {
+            benchmark::DoNotOptimize(compute.runBatch(sum, spans));
+            return;
+        }
+        for (FloatSpan data : spans) benchmark::DoNotOptimize(compute.run(sum, data));
+    };
+    Latencies latencies;
+
+    once();
+    for (auto _ : state) {
+        auto start = Clock::now();
+        once();
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, kArrays * n);
+    state.SetLabel(label + (batched ? " batch" : " per-array"));
+}
+
+}
+
+static void BM_Storage_CPU(benchmark::State& state) {
+    ComputeCPU compute;
+    runStorage(state, compute, "cpu");
+}
+
+static void BM_Storage_GPU(benchmark::State& state) {
+    std::string error;
+    ComputeGPU* gpu = sharedGpu(&error);
+    if (!gpu) {
+        state.SkipWithError(("no GL context: " + error).c_str());
+        return;
+    }
+    runStorage(state, *gpu, "gpu");
+}
+
+static void BM_Batch_CPU(benchmark::State& state) {
+    ComputeCPU compute;
+    runBatches(state, compute, "cpu");
+}
+
+static void BM_Batch_GPU(benchmark::State& state) {
+    std::string error;
+    ComputeGPU* gpu = sharedGpu(&error);
+    if (!gpu) {
+        state.SkipWithError(("no GL context: " + error).c_str());
+        return;
+    }
+    runBatches(state, *gpu, "gpu");
+}
+
+// Host -> buffer copy, waited for with glFinish. Raw GL calls go through the
+// device's submission thread, which owns the context.
+static void BM_GPU_Upload(benchmark::State& state) {
+    ComputeGPU* gpu = sharedGpu();
+    if (!gpu) {
+        state.SkipWithError("no GL context");
+        return;
+    }
+    size_t n = static_cast<size_t>(state.range(0));
+    std::vector<float> data(n, 64.0f);
+    Latencies latencies;
+
+    for (auto _ : state) {
+        auto start = Clock::now();
+        gpu->uploadData(data);
+        gpu->device().call([] { glFinish(); });
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, n);
+}
+
+// Dispatch until its fence signals. The shader time proper comes from a
+// GL_TIME_ELAPSED query and is reported as gpu_p50_ms / gpu_p99_ms; it is not
+// the iteration time because some drivers (llvmpipe) report ~0 for compute.
+static void BM_GPU_Dispatch(benchmark::State& state) {
+    ComputeGPU* gpu = sharedGpu();
+    if (!gpu) {
+        state.SkipWithError("no GL context");
+        return;
+    }
+    size_t n = static_cast<size_t>(state.range(0));
+    std::vector<float> data(n, 64.0f);
+    gpu->uploadData(data);
+    Latencies latencies;
+    Latencies shader;
+
+    GpuDevice& device = gpu->device();
+    GLuint query = device.call([] {
+        GLuint q;
+        glGenQueries(1, &q);
+        return q;
+    });
+    for (auto _ : state) {
+        auto start = Clock::now();
+        device.call([query] { glBeginQuery(GL_TIME_ELAPSED, query); });
+        Completion done = gpu->processDataGPU_NoTransfer(n, false);
+        device.call([] { glEndQuery(GL_TIME_ELAPSED); });
+        done.wait();
+        latencies.add(state, secondsSince(start));
+
+        GLuint64 ns = device.call([query] {
+            GLuint64 result = 0;
+            glGetQueryObjectui64v(query, GL_QUERY_RESULT, &result);
+            return result;
+        });
+        shader.record(ns * 1e-9);
+    }
+    device.call([&query] { glDeleteQueries(1, &query); });
+    gpu->downloadData(data);
+    latencies.report(state, n);
+    shader.reportPercentiles(state, "gpu_");
+}
+
+// Buffer -> host copy, including the fence wait for the (already finished)
+// dispatch.
+static void BM_GPU_Download(benchmark::State& state) {
+    ComputeGPU* gpu = sharedGpu();
+    if (!gpu) {
+        state.SkipWithError("no GL context");
+        return;
+    }
+    size_t n = static_cast<size_t>(state.range(0));
+    std::vector<float> data(n, 64.0f);
+    Latencies latencies;
+
+    for (auto _ : state) {
+        gpu->uploadData(data);  // downloadData consumes the buffer
+        gpu->device().call([] { glFinish(); });
+        auto start = Clock::now();
+        gpu->downloadData(data);
+        latencies.add(state, secondsSince(start));
+    }
+    latencies.report(state, n);
+}
+
+// init() through the first map and sum, the cost a short-lived worker pays.
+// Arg 0 starts each iteration from an empty program cache, arg 1 from the
+// binaries an untimed first instance stored. The shared instances are
+// released first so every iteration creates the device afresh; the label
+// says "warm context" if something else still held it. Drivers with their
+// own shader cache (Mesa) hide part of the cold cost unless it is disabled
+// (MESA_SHADER_CACHE_DISABLE=true).
+static void BM_GPU_Startup(benchmark::State& state) {
+    namespace fs = std::filesystem;
+    releaseSharedGpus();
+    bool warm = state.range(0) != 0;
+    std::string dir = (fs::temp_directory_path() / "ps_bench_program_cache").string();
+    fs::remove_all(dir);
+    std::vector<float> data(1 << 16, 64.0f);
+    auto startup = [&] {
+        ComputeGPU gpu("shaders/compute_shader.glsl");
+        gpu.setProgramCacheDirectory(dir);
+        gpu.init("shaders/compute_shader.glsl");
+        gpu.process(data);
+        gpu.run(kernels::makeReduce(kernels::Reduce::Sum), data);
+        return gpu.startup();
+    };
+    try {
+        startup();  // also checks for a context
+    } catch (const std::exception& e) {
+        state.SkipWithError(("no GL context: " + std::string(e.what())).c_str());
+        return;
+    }
+    Latencies latencies;
+    Latencies context;
+    Latencies programs;
+
+    for (auto _ : state) {
+        if (!warm) fs::remove_all(dir);
+        auto start = Clock::now();
+        GpuStartup info = startup();
+        latencies.add(state, secondsSince(start));
+        context.record(info.context_ms * 1e-3);
+        programs.record(info.program_ms * 1e-3);
+        state.SetLabel(std::string(info.context) + (info.context_ms > 0.0 ? "" : " (warm context)"));
+    }
+    fs::remove_all(dir);
+    latencies.reportPercentiles(state, "");
+    context.reportPercentiles(state, "context_");
+    programs.reportPercentiles(state, "program_");
+}
+
+BENCHMARK(BM_Backend_CPU)->Apply(sizeAndThreadSweep)->UseManualTime();
+BENCHMARK(BM_Backend_GPU)->Apply(sizeSweep)->UseManualTime();
+BENCHMARK(BM_Backend_Hybrid)->Apply(sizeSweep)->UseManualTime();
+BENCHMARK(BM_GPU_Upload)->Apply(sizeSweep)->UseManualTime();
+BENCHMARK(BM_GPU_Dispatch)->Apply(sizeSweep)->UseManualTime();
+BENCHMARK(BM_GPU_Download)->Apply(sizeSweep)->UseManualTime();
+BENCHMARK(BM_GPU_Startup)->Arg(0)->Arg(1)->UseManualTime();
+BENCHMARK(BM_Storage_CPU)->Apply(storageSweep)->UseManualTime();
+BENCHMARK(BM_Storage_GPU)->Apply(storageSweep)->UseManualTime();
+BENCHMARK(BM_Batch_CPU)->Apply(batchSweep)->UseManualTime();
+BENCHMARK(BM_Batch_GPU)->Apply(batchSweep)->UseManualTime();
+
+int main(int argc, char** argv) {
+    benchmark::Initialize(&argc, argv);
+    if (benchmark::ReportUnrecognizedArguments(argc, argv)) return 1;
+
+    // A throwaway instance, so the process's device isn't held before the
+    // benchmarks start and BM_GPU_Startup run alone sees fresh contexts.
+    std::string renderer;
+    try {
+        ComputeGPU gpu("shaders/compute_shader.glsl");
+        gpu.setProgramCacheDirectory("");
+        gpu.init("shaders/compute_shader.glsl");
+        renderer = gpu.device().call([] { return std::string(reinterpret_cast<const char*>(glGetString(GL_RENDERER))); });
+    } catch (const std::exception& e) {
+        renderer = "none (" + std::string(e.what()) + ")";
+    }
+    benchmark::AddCustomContext("gl_renderer", renderer);
+    benchmark::AddCustomContext("simd_level", simd::levelName(simd::activeLevel()));
+    benchmark::AddCustomContext("numa_nodes", std::to_string(numa::topology().nodes()));
+
+    benchmark::RunSpecifiedBenchmarks();
+    benchmark::Shutdown();
+    return 0;
+}
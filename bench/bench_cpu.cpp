@@ -0,0 +1,155 @@
+#include "cpu_compute.h"
+#include "thread_pool.h"
+#include "simd_transform.h"
+#include "hybrid_compute.h"
+#include "huge_page_allocator.h"
+#include "numa.h"
+#include <benchmark/benchmark.h>
+#include <vector>
+#include <thread>
+#include <cmath>
+
+// Per-call overhead of the CPU backend for 1K .. 2^29 elements.
+// BM_SpawnPerCall is the old ComputeCPU::process (fresh threads, static
+// chunks) kept as a reference point for the pooled version.
+
+static void transformRange(float* data, size_t start, size_t end) {
+    for (size_t i = start; i < end; i++) {
+        float& x = data[i];
+        x = std::sqrt(x) + std::sin(x) * std::cos(x) + std::exp(-x * 0.001f);
+    }
+}
+
+static void BM_SpawnPerCall(benchmark::State& state) {
+    std::vector<float> data(static_cast<size_t>(state.range(0)), 64.0f);
+    unsigned num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0) num_threads = 1;
+
+    for (auto _ : state) {
+        size_t n = data.size();
+        size_t chunk = n / num_threads;
+        std::vector<std::thread> threads;
+        for (unsigned t = 0; t < num_threads; t++) {
+            size_t start = t * chunk;
+            size_t end = (t == num_threads - 1) ? n : start + chunk;
+            threads.emplace_back(transformRange, data.data(), start, end);
+        }
+        for (auto& th : threads) th.join();
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_ComputeCPU(benchmark::State& state) {
+    std::vector<float> data(static_cast<size_t>(state.range(0)), 64.0f);
+    ComputeCPU compute;
+
+    for (auto _ : state) {
+        compute.process(data);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+// Empty body: what the pool itself costs per parallelFor call.
+static void BM_PoolDispatchOnly(benchmark::State& state) {
+    ThreadPool& pool = *ThreadPool::shared();
+    size_t n = static_cast<size_t>(state.range(0));
+
+    for (auto _ : state) {
+        pool.parallelFor(0, n, ComputeCPU::kDefaultGrainSize, [](size_t begin, size_t end) {
+            benchmark::DoNotOptimize(begin + end);
+        });
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+}
+
+static void BM_GrainSize(benchmark::State& state) {
+    std::vector<float> data(1 << 22, 64.0f);
+    ComputeCPU compute(0, static_cast<size_t>(state.range(0)));
+
+    for (auto _ : state) {
+        compute.process(data);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * static_cast<int64_t>(data.size()));
+}
+
+// Single core, one SIMD level per run (0 = scalar libm ... 3 = AVX-512).
+static void BM_SimdLevel(benchmark::State& state) {
+    simd::Level level = static_cast<simd::Level>(state.range(0));
+    if (static_cast<int>(level) > static_cast<int>(simd::detectLevel())) {
+        state.SkipWithError("level not supported on this CPU");
+        return;
+    }
+    simd::Level previous = simd::activeLevel();
+    simd::setLevel(level);
+    state.SetLabel(simd::levelName(level));
+
+    std::vector<float> data(static_cast<size_t>(state.range(1)), 64.0f);
+    for (auto _ : state) {
+        simd::transform(data.data(), data.size());
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(1));
+    simd::setLevel(previous);
+}
+
+// CPU + GPU on one buffer; falls back to CPU-only without a GL context.
+static void BM_HybridProcess(benchmark::State& state) {
+    static ComputeHybrid hybrid("shaders/compute_shader.glsl");
+    std::vector<float> data(static_cast<size_t>(state.range(0)), 64.0f);
+
+    for (auto _ : state) {
+        hybrid.process(data);
+        benchmark::ClobberMemory();
+    }
+    state.SetItemsProcessed(state.iterations() * state.range(0));
+    state.counters["gpu_fraction"] = hybrid.gpuFraction();
+    state.SetLabel(hybrid.gpuAvailable() ? "cpu+gpu" : "cpu only");
+}
+
+// Read bandwidth of a sum over 1 GB:
+//   0: std::vector filled by the main thread, unpinned pool (the old setup)
+//   1: FloatBuffer (huge pages) filled by the main thread, unpinned pool
+//   2: FloatBuffer first-touched by the workers of a pinned pool
+// On one node 2 only differs from 1 by pinning; on several it keeps every
+// worker's reads on its own node.
+static void BM_MemoryBandwidth(benchmark::State& state) {
+    const size_t n = size_t(1) << 28;
+    int mode = static_cast<int>(state.range(0));
+    auto pool = std::make_shared<ThreadPool>(0, mode == 2 ? ThreadPool::Affinity::Spread : ThreadPool::Affinity::None);
+    ComputeCPU compute(pool);
+    kernels::Kernel sum = kernels::makeReduce(kernels::Reduce::Sum);
+
+    std::vector<float> plain;
+    FloatBuffer buffer;
+    FloatSpan data;
+    if (mode == 0) {
+        plain.assign(n, 1.0f);
+        data = FloatSpan(plain);
+    } else if (mode == 1) {
+        buffer.assign(n, 1.0f);
+        data = FloatSpan(buffer);
+    } else {
+        buffer = compute.allocate(n, 1.0f);
+        data = FloatSpan(buffer);
+    }
+
+    for (auto _ : state) {
+        benchmark::DoNotOptimize(compute.run(sum, data).value);
+    }
+    state.SetBytesProcessed(state.iterations() * static_cast<int64_t>(n * sizeof(float)));
+    state.counters["nodes"] = numa::topology().nodes();
+    state.counters["pinned"] = pool->pinnedWorkers();
+    const char* labels[] = {"vector, main-thread touch", "huge pages, main-thread touch", "huge pages, worker touch, pinned"};
+    state.SetLabel(labels[mode]);
+}
+
+BENCHMARK(BM_MemoryBandwidth)->DenseRange(0, 2)->UseRealTime()->Unit(benchmark::kMillisecond);
+BENCHMARK(BM_HybridProcess)->RangeMultiplier(8)->Range(1 << 16, 1 << 28)->UseRealTime();
+BENCHMARK(BM_SimdLevel)->ArgsProduct({{0, 1, 2, 3}, {1 << 14, 1 << 24}});
+BENCHMARK(BM_SpawnPerCall)->RangeMultiplier(8)->Range(1 << 10, 1 << 29)->UseRealTime();
+BENCHMARK(BM_ComputeCPU)->RangeMultiplier(8)->Range(1 << 10, 1 << 29)->UseRealTime();
+BENCHMARK(BM_PoolDispatchOnly)->RangeMultiplier(8)->Range(1 << 10, 1 << 29)->UseRealTime();
+BENCHMARK(BM_GrainSize)->RangeMultiplier(4)->Range(1 << 10, 1 << 20)->UseRealTime();
@@ -1,9 +1,58 @@
 #pragma once
 #include <vector>
+#include "completion.h"
+#include "float_span.h"
+#include "half.h"
+#include "kernels.h"
 
 class ICompute {
 public:    
     virtual ~ICompute() = default;
 
-    virtual void process(std::vector<float>& data) = 0;
-};
\ No newline at end of file
+    // Applies the reference transform (kernels::Transform) in place. Works on
+    // caller memory directly; no copy into a std::vector is needed.
+    virtual void process(FloatSpan data) = 0;
+
+    // Runs any map / reduce / fused map-reduce kernel over data.
+    virtual kernels::Result run(const kernels::Kernel& kernel, FloatSpan data) = 0;
+
+    // Starts run(kernel, data) and returns without waiting for it. data must
+    // stay alive until the handle completes. The default runs synchronously.
+    virtual Completion submit(const kernels::Kernel& kernel, FloatSpan data) {
+        return Completion::completed(run(kernel, data));
+    }
+    Completion submit(FloatSpan data) { return submit(kernels::makeMap<kernels::Transform>(), data); }
+
+    // 16-bit storage: elements are widened to float, computed in float and,
+    // for kernels that write back, rounded to nearest even when stored. The
+    // defaults convert the whole span through a float buffer.
+    virtual kernels::Result run(const kernels::Kernel& kernel, HalfSpan data) { return runConverted(kernel, data); }
+    virtual kernels::Result run(const kernels::Kernel& kernel, BFloat16Span data) {
+        return runConverted(kernel, data);
+    }
+    void process(HalfSpan data) { run(kernels::makeMap<kernels::Transform>(), data); }
+    void process(BFloat16Span data) { run(kernels::makeMap<kernels::Transform>(), data); }
+
+    // Runs kernel over each array in one call, returning one result per
+    // array, so many small arrays don't each pay for a dispatch. The default
+    // runs them one at a time.
+    virtual std::vector<kernels::Result> runBatch(const kernels::Kernel& kernel, const std::vector<FloatSpan>& arrays) {
+        std::vector<kernels::Result> results;
+        results.reserve(arrays.size());
+        for (FloatSpan data : arrays) results.push_back(run(kernel, data));
+        return results;
+    }
+
+    void process(std::vector<float>& data) { process(FloatSpan(data)); }
+    kernels::Result run(const kernels::Kernel& kernel, std::vector<float>& data) { return run(kernel, FloatSpan(data)); }
+
+private:
+    template <class T>
+    kernels::Result runConverted(const kernels::Kernel& kernel, StridedSpan<T> data) {
+        std::vector<float> values(data.size());
+        gatherSpan(data, 0, values.size(), values.data());
+        kernels::Result result = run(kernel, FloatSpan(values));
+        if (kernel.writeBack()) scatterSpan(values.data(), values.size(), data, 0);
+        return result;
+    }
+};
@@ -0,0 +1,58 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstddef>
+#include <map>
+#include <vector>
+
+// Shader storage buffers recycled by capacity, so jobs of varying sizes reuse
+// storage instead of reallocating it with glBufferData. Capacities are
+// rounded up to a power of two (at least kMinBytes) up to kFineBytes, and
+// past that to a multiple of an eighth of the power of two below: a request
+// costs at most twice its size below 64 MB and at most 12.5% more above
+// (a 1 GB + 1 byte buffer takes 1.125 GB, not 2 GB). Released buffers wait
+// in per-capacity free lists, up to max_idle_bytes in total, after which the
+// largest idle ones are deleted.
+//
+// GL objects: use only on the thread that owns the context.
+class BufferPool {
+public:
+    struct Buffer {
+        GLuint id = 0;
+        size_t capacity = 0;  // bytes
+    };
+
+    struct Stats {
+        size_t allocated = 0;   // glBufferData calls
+        size_t reused = 0;      // acquisitions served from a free list
+        size_t idle_bytes = 0;  // held in free lists now
+    };
+
+    static constexpr size_t kMinBytes = 64 << 10;
+    static constexpr size_t kFineBytes = 64 << 20;
+
+    // The capacity acquire() allocates for bytes.
+    static size_t bucketFor(size_t bytes);
+
+    explicit BufferPool(size_t max_idle_bytes = size_t(256) << 20) : max_idle_bytes(max_idle_bytes) {}
+    BufferPool(const BufferPool&) = delete;
+    BufferPool& operator=(const BufferPool&) = delete;
+
+    // At least bytes of storage; contents are undefined.
+    Buffer acquire(size_t bytes);
+    // Returns buffer to the pool and clears it. No-op for an empty Buffer.
+    void release(Buffer& buffer);
+    // Keeps buffer when it already holds bytes, otherwise swaps it for a
+    // big enough one. Returns true when it had to swap (contents are lost).
+    bool reserve(Buffer& buffer, size_t bytes);
+    // Deletes every idle buffer.
+    void clear();
+
+    const Stats& stats() const { return g_stats; }
+
+private:
+    void trim();
+
+    size_t max_idle_bytes;
+    std::map<size_t, std::vector<GLuint>> g_free;  // by capacity
+    Stats g_stats;
+};
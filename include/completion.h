@@ -0,0 +1,45 @@
+#pragma once
+#include <exception>
+#include <memory>
+#include <vector>
+#include "kernels.h"
+
+// Handle to work started with ICompute::submit(). Copies share the same
+// job. ready() never blocks; wait() blocks until the job is done and
+// rethrows its error, if any; get() also returns the kernel's result (empty
+// for maps).
+//
+// Handles may be polled and waited on from any thread. Dropping a handle
+// does not cancel anything: CPU work is waited for when the last copy goes
+// away, GPU work is finished on the device's submission thread once its
+// fence signals, or on shutdown().
+class Completion {
+public:
+    struct State {
+        virtual ~State() = default;
+        // Non-blocking; may finish the job (e.g. read back GPU results).
+        virtual bool poll() = 0;
+        // Blocks until done; fills result or error.
+        virtual void wait() = 0;
+
+        kernels::Result result;
+        std::exception_ptr error;
+    };
+
+    // An already completed handle.
+    Completion() = default;
+    explicit Completion(std::shared_ptr<State> state) : state(std::move(state)) {}
+    static Completion completed(kernels::Result result);
+
+    bool ready() const { return !state || state->poll(); }
+    void wait() const;
+    kernels::Result get() const;
+
+private:
+    std::shared_ptr<State> state;
+};
+
+// Completes when every handle has; wait() waits for all of them before
+// rethrowing the first error. Individual results stay available through
+// the original handles.
+Completion whenAll(std::vector<Completion> handles);
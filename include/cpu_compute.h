@@ -1,12 +1,58 @@
 #pragma once
 #include <vector>
+#include <memory>
 #include "ICompute.h"
+#include "huge_page_allocator.h"
+#include "thread_pool.h"
 
 class ComputeCPU : public ICompute {
 public:
-    ComputeCPU() = default;
-    void process(std::vector<float>& data) override;
+    // Elements handed to a worker at a time. Small enough to balance load
+    // across cores, large enough to amortize the deque traffic.
+    static constexpr size_t kDefaultGrainSize = 1 << 14;
+
+    // num_threads == 0 shares ThreadPool::shared() with every other default
+    // instance; any other value gives this instance its own pool.
+    explicit ComputeCPU(unsigned num_threads = 0, size_t grain_size = kDefaultGrainSize);
+    explicit ComputeCPU(std::shared_ptr<ThreadPool> pool, size_t grain_size = kDefaultGrainSize);
+
+    using ICompute::process;
+    using ICompute::run;
+    using ICompute::submit;
+    // Strided spans are gathered into a small tile per range, processed and
+    // scattered back; contiguous spans are processed where they are.
+    void process(FloatSpan data) override;
+    kernels::Result run(const kernels::Kernel& kernel, FloatSpan data) override;
+    // Queues the ranges on the pool and returns; any thread may poll or wait.
+    Completion submit(const kernels::Kernel& kernel, FloatSpan data) override;
+    // Each worker converts a small tile into float, runs the kernel on it
+    // and converts it back, so no float copy of the whole span is made.
+    kernels::Result run(const kernels::Kernel& kernel, HalfSpan data) override;
+    kernels::Result run(const kernels::Kernel& kernel, BFloat16Span data) override;
+    // One parallel loop over the arrays laid end to end, so small arrays
+    // share ranges instead of each waking the pool.
+    std::vector<kernels::Result> runBatch(const kernels::Kernel& kernel, const std::vector<FloatSpan>& arrays) override;
+
+    // A buffer of `count` copies of `value`, written by the workers that will
+    // process each part of it so that, with a pinned pool
+    // (ThreadPool::Affinity::Spread), every page is local to its worker's node.
+    FloatBuffer allocate(size_t count, float value = 0.0f) const;
+
+    void setGrainSize(size_t grain_size);
+    size_t grainSize() const { return grain; }
+    unsigned threadCount() const { return pool->size(); }
+    const std::shared_ptr<ThreadPool>& threadPool() const { return pool; }
 
     ~ComputeCPU() {
     }
-};
\ No newline at end of file
+    // Runs kernel over data[start, end) on the calling thread.
+    static void runRange(const kernels::Kernel& kernel, FloatSpan data, size_t start, size_t end,
+                         kernels::Partial& acc);
+
+private:
+    template <class T>
+    kernels::Result runSpan(const kernels::Kernel& kernel, StridedSpan<T> data);
+
+    std::shared_ptr<ThreadPool> pool;
+    size_t grain;
+};
@@ -0,0 +1,36 @@
+#pragma once
+#include <string>
+#include "ICompute.h"
+#include "kernels.h"
+
+// Out-of-core processing of raw native-endian float32 files. The input is
+// mapped, not read, and walked one window at a time: the next window is
+// prefetched while the current one is processed, and finished windows are
+// dropped from the resident set, so memory use stays around
+// (1 + readahead_windows) windows (twice that with a separate output file)
+// whatever the file size. Inside a window the backend does its own cache
+// tiling (ComputeCPU's grain, ComputeGPU's dispatch).
+struct FileOptions {
+    size_t window_bytes = 64 << 20;  // rounded up to a whole number of pages
+    unsigned readahead_windows = 1;
+};
+
+struct FileStats {
+    size_t bytes = 0;       // input size
+    size_t windows = 0;
+    double total_ms = 0.0;
+    kernels::Result result; // reductions over the whole file
+
+    // Input bytes per second, comparable with measureReadBandwidthGBs().
+    double throughputGBs() const { return total_ms > 0.0 ? bytes / (total_ms * 1e6) : 0.0; }
+};
+
+// Runs kernel over every float in `input`. Map kernels write to `output`
+// (created or truncated to the input's size), or back into `input` when
+// output is empty. Reduce-only kernels never write and take no output.
+FileStats processFile(ICompute& compute, const kernels::Kernel& kernel, const std::string& input,
+                      const std::string& output = std::string(), const FileOptions& options = FileOptions());
+
+// The project's transform, as ICompute::process.
+FileStats processFile(ICompute& compute, const std::string& input, const std::string& output = std::string(),
+                      const FileOptions& options = FileOptions());
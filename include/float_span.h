@@ -0,0 +1,68 @@
+#pragma once
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+#include <utility>
+
+// Non-owning view of caller memory: a std::vector, an mmap'd file, a GL
+// mapping, one channel of interleaved data. stride is in elements; 1 means
+// contiguous. The caller keeps the memory alive for the duration of the call.
+template <class T>
+class StridedSpan;
+
+template <class C>
+struct IsStridedSpan : std::false_type {};
+template <class T>
+struct IsStridedSpan<StridedSpan<T>> : std::true_type {};
+
+template <class T>
+class StridedSpan {
+public:
+    StridedSpan() = default;
+    StridedSpan(T* data, size_t count, size_t stride = 1) : ptr(data), n(count), step(stride ? stride : 1) {}
+
+    // Any contiguous container with data()/size(), e.g. std::vector<float>.
+    template <class C, class = std::enable_if_t<!IsStridedSpan<std::remove_const_t<C>>::value &&
+                                                 std::is_convertible<decltype(std::declval<C&>().data()), T*>::value>>
+    StridedSpan(C& container) : ptr(container.data()), n(container.size()) {}
+
+    // float -> const float
+    template <class U, class = std::enable_if_t<std::is_convertible<U*, T*>::value && !std::is_same<U, T>::value>>
+    StridedSpan(const StridedSpan<U>& other) : ptr(other.data()), n(other.size()), step(other.stride()) {}
+
+    T* data() const { return ptr; }
+    size_t size() const { return n; }
+    size_t stride() const { return step; }
+    bool empty() const { return n == 0; }
+    bool contiguous() const { return step == 1; }
+
+    T& operator[](size_t i) const { return ptr[i * step]; }
+
+    StridedSpan subspan(size_t offset, size_t count) const { return StridedSpan(ptr + offset * step, count, step); }
+
+private:
+    T* ptr = nullptr;
+    size_t n = 0;
+    size_t step = 1;
+};
+
+using FloatSpan = StridedSpan<float>;
+using ConstFloatSpan = StridedSpan<const float>;
+
+// Copies span[offset, offset + count) into dst.
+inline void gatherSpan(ConstFloatSpan span, size_t offset, size_t count, float* dst) {
+    if (span.contiguous()) {
+        std::memcpy(dst, span.data() + offset, count * sizeof(float));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) dst[i] = span[offset + i];
+}
+
+// Copies src[0, count) into span[offset, offset + count).
+inline void scatterSpan(const float* src, size_t count, FloatSpan span, size_t offset) {
+    if (span.contiguous()) {
+        std::memcpy(span.data() + offset, src, count * sizeof(float));
+        return;
+    }
+    for (size_t i = 0; i < count; i++) span[offset + i] = src[i];
+}
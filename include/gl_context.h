@@ -0,0 +1,38 @@
+#pragma once
+#include <GL/glew.h>
+#include <GLFW/glfw3.h>
+
+// An offscreen GL 4.3+ core context, current on the creating thread.
+//
+// Where EGL is available (PS_HAVE_EGL) it is tried first: the surfaceless
+// platform (EGL_MESA_platform_surfaceless, e.g. llvmpipe) needs no X or
+// Wayland display, then the default EGL display. Otherwise, or when neither
+// gives a context, it falls back to a hidden 1x1 GLFW window; GLFW is
+// initialized with the first such context and terminated with the last, and
+// those must be created and destroyed on the main thread.
+class GLContext {
+public:
+    enum class Api { Egl, Glfw };
+
+    // Throws std::runtime_error when no context can be created.
+    GLContext();
+    ~GLContext();
+    GLContext(const GLContext&) = delete;
+    GLContext& operator=(const GLContext&) = delete;
+
+    void makeCurrent();
+    // Leaves no context current on the calling thread, so another thread
+    // can make this one current.
+    void release();
+    Api api() const { return g_api; }
+    const char* apiName() const { return g_api == Api::Egl ? "egl" : "glfw"; }
+
+private:
+    bool createEgl();
+    void createGlfw();
+    void destroy();
+
+    Api g_api = Api::Glfw;
+    GLFWwindow* g_window = nullptr;
+    void* g_egl_context = nullptr;  // EGLContext
+};
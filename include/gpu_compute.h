@@ -3,8 +3,44 @@
 #include <GL/glew.h>
 #include <GLFW/glfw3.h>
 #include "ICompute.h"
+#include "gpu_device.h"
 #include <string>
+#include <memory>
+#include <unordered_map>
 
+// Chunked upload/compute/download with `slots` persistently mapped buffers,
+// so copying chunk N+1 in, computing chunk N and copying chunk N-1 out overlap.
+struct StreamingOptions {
+    size_t chunk_elements = 1 << 22;  // 16 MB of floats per slot
+    unsigned slots = 3;               // 2 (double) to 4 buffers
+};
+
+struct StreamingStats {
+    size_t chunks = 0;
+    size_t bytes = 0;          // bytes streamed in (the same amount comes back)
+    double upload_ms = 0.0;    // copying into mapped slots
+    double wait_ms = 0.0;      // blocked on slot fences
+    double download_ms = 0.0;  // copying out of mapped slots
+    double total_ms = 0.0;
+
+    // End-to-end: bytes in + bytes out over wall time.
+    double throughputGBs() const { return total_ms > 0.0 ? 2.0 * bytes / (total_ms * 1e6) : 0.0; }
+};
+
+// Where init() spends its time.
+struct GpuStartup {
+    const char* context = "";    // "egl" or "glfw"
+    double context_ms = 0.0;     // creating the device; 0 when it already existed
+    double program_ms = 0.0;     // building (or loading) the init() shader
+    bool program_from_disk = false;
+};
+
+// A lightweight handle on the process's GpuDevice: every instance shares
+// one context and buffer pool (and, per cache directory, one program cache),
+// and runs its GL work on the device's submission thread. Each instance
+// keeps its own data buffer and jobs, so give every service thread its own
+// ComputeGPU; Completion handles and MappedViews may be used from any
+// thread.
 class ComputeGPU : public ICompute {
 public:
     ComputeGPU(const char* shaderPath) {
@@ -14,21 +50,144 @@ public:
         shutdown();
     }
 
-    void process(std::vector<float>& data) override;
-    void processDataGPU_NoTransfer(size_t data_count, bool wait_for_completion);
-    void downloadData(std::vector<float>& data);
+    // Read-only view of results still in the GPU buffer, so the caller can
+    // read them in place instead of having them copied out. Contract:
+    //  - valid until destroyed; destroy it before shutdown() or destroying the
+    //    ComputeGPU;
+    //  - while it lives, upload/process/run/download on the owner throw.
+    class MappedView {
+    public:
+        MappedView(MappedView&& other) noexcept;
+        MappedView& operator=(MappedView&&) = delete;
+        ~MappedView();
+
+        const float* data() const { return ptr; }
+        size_t size() const { return count; }
+        const float* begin() const { return ptr; }
+        const float* end() const { return ptr + count; }
+        float operator[](size_t i) const { return ptr[i]; }
+
+    private:
+        friend class ComputeGPU;
+        MappedView(ComputeGPU* owner, const float* ptr, size_t count) : owner(owner), ptr(ptr), count(count) {}
+
+        ComputeGPU* owner;
+        const float* ptr;
+        size_t count;
+    };
+
+    using ICompute::process;
+    using ICompute::run;
+    using ICompute::submit;
+    void process(FloatSpan data) override;
+    // Builds (once per kernel key) a program from kernel_template.glsl, found
+    // next to the shader passed to init().
+    kernels::Result run(const kernels::Kernel& kernel, FloatSpan data) override;
+    // Uploads data into buffers owned by this job, dispatches and fences, then
+    // returns; the device reads results back as soon as the fence signals,
+    // and ready() only checks a flag. Any number of jobs may be in flight:
+    // they share the context but no buffers, and complete in any order.
+    Completion submit(const kernels::Kernel& kernel, FloatSpan data) override;
+    // 16-bit data stays packed on the GPU, halving both transfers, and is
+    // widened in the shader: unpackHalf2x16 for Half, bit shifts for BFloat16.
+    kernels::Result run(const kernels::Kernel& kernel, HalfSpan data) override;
+    kernels::Result run(const kernels::Kernel& kernel, BFloat16Span data) override;
+    // One upload, one dispatch and one download for the whole batch: the
+    // arrays are packed into one buffer, each padded to a workgroup boundary,
+    // with an offsets table telling each workgroup which array it is in.
+    std::vector<kernels::Result> runBatch(const kernels::Kernel& kernel, const std::vector<FloatSpan>& arrays) override;
+    // Requires GL 4.4 / ARB_buffer_storage. The kernel overload accepts map
+    // kernels only.
+    StreamingStats processStreaming(FloatSpan data, const StreamingOptions& options = StreamingOptions());
+    StreamingStats processStreaming(const kernels::Kernel& kernel, FloatSpan data,
+                                    const StreamingOptions& options = StreamingOptions());
+    // Without wait_for_completion, the returned handle tracks the dispatch.
+    Completion processDataGPU_NoTransfer(size_t data_count, bool wait_for_completion);
+    // Strided spans are gathered into / scattered out of a buffer mapping
+    // directly, without a staging vector.
+    void downloadData(FloatSpan data);
+    // Waits for queued work and maps the first count results for reading.
+    MappedView mapResults(size_t count);
+    // Programs are cached in ProgramCache::defaultDirectory() unless set
+    // otherwise before init(); an empty path keeps them in memory only.
+    // Instances with different directories still share the device.
+    void setProgramCacheDirectory(std::string directory) { g_cache_dir = std::move(directory); }
     void init(const char* shaderPath);
+    // Finishes this instance's jobs and returns its buffers to the pool; the
+    // device goes away with its last instance.
     void shutdown();
-    void uploadData(const std::vector<float>& data);
+    const GpuStartup& startup() const { return g_startup; }
+    // Throws if not initialized. Raw GL calls go through device().call().
+    GpuDevice& device() const;
+    // Device-wide; zero before init().
+    ProgramCache::Stats programCacheStats() const;
+    BufferPool::Stats bufferPoolStats() const;
+    void uploadData(ConstFloatSpan data);
 private:
-    GLuint createComputeShaderProgram(const char* shaderPath);
     std::string loadShaderSource(const char* filePath);
+    std::string buildKernelSource(const kernels::Kernel& kernel, Storage storage, bool batched);
+    const ProgramCache::Program& kernelProgram(const kernels::Kernel& kernel, Storage storage = Storage::F32,
+                                               bool batched = false);
+    void computeGroups(size_t data_count, GLuint& groups_x, GLuint& groups_y) const;
+    // Sizes the partials/bins buffers, binds all three and dispatches
+    // program over count elements of data_buffer. A batched program also
+    // needs its offsets table bound at binding 3. Returns the workgroup count.
+    size_t dispatchKernel(const ProgramCache::Program& program, const kernels::Kernel& kernel, size_t count,
+                          GLuint data_buffer, BufferPool::Buffer& partials, BufferPool::Buffer& bins,
+                          Storage storage = Storage::F32, size_t arrays = 1);
+    // One Partial per array: array a owns workgroups
+    // [group_bounds[a], group_bounds[a + 1]) and the a-th set of bins.
+    std::vector<kernels::Partial> readPartials(const kernels::Kernel& kernel, const std::vector<size_t>& group_bounds,
+                                               GLuint partials_buffer, GLuint bins_buffer);
+    // Blocks until all GL work queued so far is done.
+    void waitForGpu();
+    // Uploads data into buffer, growing it through the pool if needed.
+    template <class T>
+    void fillBuffer(BufferPool::Buffer& buffer, StridedSpan<const T> data);
+    // Copies the first data.size() elements of buffer into data.
+    template <class T>
+    void readBuffer(GLuint buffer, StridedSpan<T> data);
+    template <class T>
+    kernels::Result runPacked(const kernels::Kernel& kernel, StridedSpan<T> data, Storage storage);
+    void requireUnmapped() const;
+    void releaseMappedView();
+
+    struct StreamSlot {
+        GLuint buffer = 0;
+        float* mapped = nullptr;
+        GLsync fence = nullptr;
+        size_t offset = 0;
+        size_t count = 0;
+    };
+    StreamingStats streamWithProgram(const ProgramCache::Program& program, FloatSpan data,
+                                     const StreamingOptions& options);
+    void ensureStreamSlots(const StreamingOptions& options);
+    void retireStreamSlot(StreamSlot& slot, FloatSpan data, StreamingStats& stats);
+    void releaseStreamSlots();
+
+    struct GpuJob;
+    void finishJob(GpuJob& job);
+    void pruneJobs();
 
-    GLuint g_program = 0;
-    GLFWwindow* g_window = nullptr;
-    GLuint sbo = 0;
-    GLint max_group_size;
-    size_t g_buffer_size = 0;
+    std::shared_ptr<GpuDevice> g_device;
+    std::string g_cache_dir = ProgramCache::defaultDirectory();
+    ProgramCache* g_programs = nullptr;  // the device's cache for g_cache_dir
+    GpuStartup g_startup;
+    const ProgramCache::Program* g_program = nullptr;
+    BufferPool::Buffer sbo;
+    BufferPool::Buffer partials_sbo;
+    BufferPool::Buffer bins_sbo;
+    BufferPool::Buffer segments_sbo;  // runBatch's offsets table
+    std::string g_shader_dir;
+    std::string g_kernel_template;
+    // By kernel key, so run() doesn't rebuild the source to look it up.
+    std::unordered_map<std::string, const ProgramCache::Program*> g_kernel_programs;
+    std::vector<StreamSlot> g_stream_slots;
+    size_t g_stream_chunk = 0;
+    std::vector<std::shared_ptr<GpuJob>> g_jobs;  // submitted, not yet finished
+    GLint max_group_size = 0;
+    size_t g_buffer_size = 0;  // bytes of sbo in use
     bool g_data_on_gpu = false;
+    bool g_results_mapped = false;
     bool gpu_initialized = false;
 };
\ No newline at end of file
@@ -0,0 +1,101 @@
+#pragma once
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <utility>
+#include <vector>
+#include "buffer_pool.h"
+#include "gl_context.h"
+#include "program_cache.h"
+
+// The process's one GL device, shared by every ComputeGPU: one context,
+// current only on a dedicated submission thread, plus the buffer pool and a
+// program cache per cache directory that live in it. Callers hand GL work to
+// that thread with call() instead of sharing a context, so any number of
+// threads can drive the GPU at once; commands run one at a time, in arrival
+// order.
+//
+// acquire() creates the device on first use, making the context on the
+// calling thread before handing it to the submission thread. The last
+// reference to go away stops the thread and destroys the context (and, on
+// the GLFW fallback, terminates GLFW) on the thread that dropped it, so
+// instances can come and go independently. GLFW only allows this on the main
+// thread: without EGL, create and drop the last ComputeGPU there.
+class GpuDevice {
+public:
+    // Throws std::runtime_error when no context can be created. Sets
+    // *created when this call made the device.
+    static std::shared_ptr<GpuDevice> acquire(bool* created = nullptr);
+    ~GpuDevice();
+    GpuDevice(const GpuDevice&) = delete;
+    GpuDevice& operator=(const GpuDevice&) = delete;
+
+    // Runs fn on the submission thread and returns its result, rethrowing
+    // whatever it throws. On the submission thread itself, runs fn inline.
+    template <typename Fn>
+    auto call(Fn&& fn) -> decltype(fn());
+
+    // Blocks until fence is signaled. Off the submission thread it waits in
+    // kWaitSliceNs slices, so other callers' commands run in between.
+    void waitFence(GLsync fence);
+    static constexpr GLuint64 kWaitSliceNs = 1000000;
+    bool onSubmissionThread() const { return std::this_thread::get_id() == g_thread_id; }
+
+    // Submission thread only. Runs on_signaled there once fence signals:
+    // watched fences are tested with a zero timeout after every command and
+    // every kWaitSliceNs while idle. Unwatch a fence before deleting it.
+    void watchFence(GLsync fence, std::function<void()> on_signaled);
+    void unwatchFence(GLsync fence);
+
+    // Submission thread only. The cache for directory is created by its
+    // first user and its programs deleted when the last one releases it.
+    ProgramCache& acquirePrograms(const std::string& directory);
+    void releasePrograms(const std::string& directory);
+    BufferPool& buffers() { return g_buffers; }
+
+    GLint maxGroupsX() const { return g_max_groups_x; }
+    const char* apiName() const { return g_api; }
+    double contextMs() const { return g_context_ms; }
+
+private:
+    GpuDevice() = default;
+    void start();
+    void post(std::function<void()> command);
+    void loop();
+    void checkWatches();
+
+    std::unique_ptr<GLContext> g_context;
+    struct SharedPrograms {
+        std::unique_ptr<ProgramCache> cache;
+        unsigned users = 0;
+    };
+    std::unordered_map<std::string, SharedPrograms> g_programs;  // by directory
+    BufferPool g_buffers;
+    GLint g_max_groups_x = 0;
+    const char* g_api = "";
+    double g_context_ms = 0.0;
+
+    std::mutex g_mutex;
+    std::condition_variable g_wake;
+    std::deque<std::function<void()>> g_queue;
+    std::vector<std::pair<GLsync, std::function<void()>>> g_watches;  // submission thread only
+    bool g_stopping = false;
+    std::thread g_thread;
+    std::thread::id g_thread_id;
+};
+
+template <typename Fn>
+auto GpuDevice::call(Fn&& fn) -> decltype(fn()) {
+    if (onSubmissionThread()) return fn();
+    // The caller blocks until the task has run, so it can live on this stack.
+    std::packaged_task<decltype(fn())()> task(std::ref(fn));
+    auto result = task.get_future();
+    post([&task] { task(); });
+    return result.get();
+}
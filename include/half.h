@@ -0,0 +1,47 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include "float_span.h"
+
+// 16-bit storage for data that doesn't need float precision, halving memory
+// and transfer traffic. Backends widen each element to float, compute in
+// float and round results back to nearest even:
+//   Half      IEEE binary16: 11-bit significand, finite up to 65504.
+//   BFloat16  the top half of a float: 8-bit significand, float's range.
+struct Half {
+    uint16_t bits;
+};
+
+struct BFloat16 {
+    uint16_t bits;
+};
+
+using HalfSpan = StridedSpan<Half>;
+using ConstHalfSpan = StridedSpan<const Half>;
+using BFloat16Span = StridedSpan<BFloat16>;
+using ConstBFloat16Span = StridedSpan<const BFloat16>;
+
+enum class Storage {
+    F32,
+    F16,
+    BF16
+};
+
+float toFloat(Half h);
+float toFloat(BFloat16 b);
+// NaNs stay (quiet) NaNs; Half overflows to infinity past 65504.
+Half toHalf(float x);
+BFloat16 toBFloat16(float x);
+
+// Whole blocks, vectorized at the active simd::Level (F16C with AVX2,
+// AVX-512F); the scalar functions above give the same results.
+void toFloat(const Half* src, size_t count, float* dst);
+void toFloat(const BFloat16* src, size_t count, float* dst);
+void fromFloat(const float* src, size_t count, Half* dst);
+void fromFloat(const float* src, size_t count, BFloat16* dst);
+
+// Converting counterparts of gatherSpan / scatterSpan.
+void gatherSpan(ConstHalfSpan span, size_t offset, size_t count, float* dst);
+void gatherSpan(ConstBFloat16Span span, size_t offset, size_t count, float* dst);
+void scatterSpan(const float* src, size_t count, HalfSpan span, size_t offset);
+void scatterSpan(const float* src, size_t count, BFloat16Span span, size_t offset);
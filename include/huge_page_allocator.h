@@ -0,0 +1,39 @@
+#pragma once
+#include <cstddef>
+#include <new>
+#include <utility>
+#include <vector>
+
+// Large blocks (>= 2 MB) come straight from the OS, 2 MB aligned and
+// advised for transparent huge pages, and are not touched here: each page
+// is placed on the node of the thread that first writes it. Smaller blocks
+// are 64-byte aligned heap memory. Both report failure with std::bad_alloc.
+void* allocateHugePages(size_t bytes);
+void freeHugePages(void* ptr, size_t bytes);
+
+// std::allocator replacement on top of allocateHugePages. construct() with
+// no arguments default-initializes, so FloatBuffer(n) leaves the memory
+// untouched for a parallel first touch (see ComputeCPU::allocate).
+template <class T>
+struct HugePageAllocator {
+    using value_type = T;
+
+    HugePageAllocator() = default;
+    template <class U>
+    HugePageAllocator(const HugePageAllocator<U>&) {}
+
+    T* allocate(size_t n) { return static_cast<T*>(allocateHugePages(n * sizeof(T))); }
+    void deallocate(T* p, size_t n) { freeHugePages(p, n * sizeof(T)); }
+
+    template <class U>
+    void construct(U* p) { ::new (static_cast<void*>(p)) U; }
+    template <class U, class... Args>
+    void construct(U* p, Args&&... args) { ::new (static_cast<void*>(p)) U(std::forward<Args>(args)...); }
+
+    template <class U>
+    bool operator==(const HugePageAllocator<U>&) const { return true; }
+    template <class U>
+    bool operator!=(const HugePageAllocator<U>&) const { return false; }
+};
+
+using FloatBuffer = std::vector<float, HugePageAllocator<float>>;
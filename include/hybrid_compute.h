@@ -0,0 +1,53 @@
+#pragma once
+#include <vector>
+#include <memory>
+#include "ICompute.h"
+#include "cpu_compute.h"
+#include "gpu_compute.h"
+#include "thread_pool.h"
+
+struct HybridOptions {
+    double initial_gpu_fraction = 0.5;
+    size_t min_gpu_elements = 1 << 16;  // smaller jobs stay on the CPU
+    double smoothing = 0.3;             // weight of the newest throughput sample
+    StreamingOptions streaming;         // used for the GPU share of map kernels
+    size_t grain_size = ComputeCPU::kDefaultGrainSize;
+};
+
+// Splits each buffer between the CPU pool and the GPU: the CPU processes the
+// front, the GPU the back, both in place, so there is nothing to merge for
+// maps and only two small results to combine for reductions. The split
+// follows the throughput each side showed on earlier calls.
+//
+// The calling thread feeds the GPU through the shared device while the pool
+// runs the CPU share; use an instance from one thread at a time. If no GL
+// context or shader can be set up, everything runs on the CPU.
+class ComputeHybrid : public ICompute {
+public:
+    explicit ComputeHybrid(const char* shaderPath, const HybridOptions& options = HybridOptions(),
+                           std::shared_ptr<ThreadPool> pool = nullptr);
+
+    using ICompute::process;
+    using ICompute::run;
+    void process(FloatSpan data) override;
+    kernels::Result run(const kernels::Kernel& kernel, FloatSpan data) override;
+
+    bool gpuAvailable() const { return gpu != nullptr; }
+    // Share of the next large job that goes to the GPU.
+    double gpuFraction() const { return gpu ? gpu_fraction : 0.0; }
+    // Smoothed elements per millisecond; 0 until measured.
+    double cpuRate() const { return cpu_rate; }
+    double gpuRate() const { return gpu_rate; }
+
+    ~ComputeHybrid() {
+    }
+private:
+    void updateSplit(size_t cpu_count, double cpu_ms, size_t gpu_count, double gpu_ms);
+
+    HybridOptions options;
+    std::shared_ptr<ThreadPool> pool;
+    std::unique_ptr<ComputeGPU> gpu;
+    double gpu_fraction;
+    double cpu_rate = 0.0;
+    double gpu_rate = 0.0;
+};
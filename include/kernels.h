@@ -0,0 +1,198 @@
+#pragma once
+#include <algorithm>
+#include <cstddef>
+#include <cstdint>
+#include <limits>
+#include <string>
+#include <type_traits>
+#include <vector>
+#include "simd_transform.h"
+
+// Kernels for ICompute::run: an element-wise map, an optional reduction over
+// the mapped values, or both fused into one pass over the data.
+//
+// A map op is a struct with
+//     static constexpr const char* name;   // unique, also the GPU program cache key
+//     static constexpr const char* glsl;   // GLSL statements updating `float x` in place
+//     static float apply(float x);         // CPU definition of the same function
+// and optionally `static void block(float* data, size_t count)` for a
+// vectorized CPU path (MapOp supplies a scalar loop over apply()).
+namespace kernels {
+
+enum class Reduce {
+    None,
+    Sum,
+    Min,
+    Max,
+    Histogram
+};
+
+// Uniform bins over [lo, hi). Values outside the range and NaNs are dropped.
+struct HistogramSpec {
+    float lo = 0.0f;
+    float hi = 1.0f;
+    uint32_t bins = 0;
+};
+
+struct Result {
+    double value = 0.0;                 // Sum / Min / Max
+    std::vector<uint64_t> histogram;    // Histogram
+};
+
+// Running reduction state for one range; ranges are merged with merge().
+struct Partial {
+    double sum = 0.0;
+    float min = std::numeric_limits<float>::infinity();
+    float max = -std::numeric_limits<float>::infinity();
+    std::vector<uint64_t> bins;
+
+    void merge(const Partial& other);
+};
+
+class Kernel;
+using CpuRangeFn = void (*)(float* data, size_t count, const Kernel& kernel, Partial& acc);
+
+class Kernel {
+public:
+    Kernel(std::string name, std::string glsl, CpuRangeFn cpu, Reduce reduce, bool write_back,
+           HistogramSpec histogram = {});
+
+    const std::string& name() const { return kernel_name; }
+    const std::string& glsl() const { return glsl_map; }
+    Reduce reduce() const { return reduce_op; }
+    bool writeBack() const { return write_back; }
+    const HistogramSpec& histogram() const { return hist; }
+
+    // Identifies the generated GPU program: name + reduction + write-back.
+    std::string key() const;
+
+    void runCpu(float* data, size_t count, Partial& acc) const { cpu_fn(data, count, *this, acc); }
+    Result finish(const Partial& total) const;
+    // Combines results of the same kernel over two disjoint ranges.
+    Result merge(const Result& a, const Result& b) const;
+
+private:
+    std::string kernel_name;
+    std::string glsl_map;
+    CpuRangeFn cpu_fn;
+    Reduce reduce_op;
+    bool write_back;
+    HistogramSpec hist;
+};
+
+template <class Op>
+struct MapOp {
+    static void block(float* data, size_t count) {
+        for (size_t i = 0; i < count; i++) data[i] = Op::apply(data[i]);
+    }
+};
+
+struct Identity : MapOp<Identity> {
+    static constexpr const char* name = "identity";
+    static constexpr const char* glsl = "";
+    static float apply(float x) { return x; }
+    static void block(float*, size_t) {}
+};
+
+// The project's reference formula; the CPU path is the SIMD kernel.
+struct Transform : MapOp<Transform> {
+    static constexpr const char* name = "transform";
+    static constexpr const char* glsl = "x = sqrt(x) + sin(x) * cos(x) + exp(-x * 0.001);";
+    static float apply(float x) { return simd::transformScalar(x); }
+    static void block(float* data, size_t count) { simd::transform(data, count); }
+};
+
+struct Square : MapOp<Square> {
+    static constexpr const char* name = "square";
+    static constexpr const char* glsl = "x = x * x;";
+    static float apply(float x) { return x * x; }
+};
+
+struct Abs : MapOp<Abs> {
+    static constexpr const char* name = "abs";
+    static constexpr const char* glsl = "x = abs(x);";
+    static float apply(float x) { return x < 0.0f ? -x : x; }
+};
+
+namespace detail {
+
+template <Reduce R>
+void accumulate(const float* values, size_t count, const HistogramSpec& hist, Partial& acc) {
+    if constexpr (R == Reduce::Sum) {
+        double s = 0.0;
+        for (size_t i = 0; i < count; i++) s += values[i];
+        acc.sum += s;
+    } else if constexpr (R == Reduce::Min) {
+        float m = acc.min;
+        for (size_t i = 0; i < count; i++) m = std::min(m, values[i]);
+        acc.min = m;
+    } else if constexpr (R == Reduce::Max) {
+        float m = acc.max;
+        for (size_t i = 0; i < count; i++) m = std::max(m, values[i]);
+        acc.max = m;
+    } else if constexpr (R == Reduce::Histogram) {
+        // Same arithmetic as kernel_template.glsl so both backends bin alike.
+        float scale = static_cast<float>(hist.bins) / (hist.hi - hist.lo);
+        float limit = static_cast<float>(hist.bins);
+        if (acc.bins.size() != hist.bins) acc.bins.assign(hist.bins, 0);
+        for (size_t i = 0; i < count; i++) {
+            float pos = (values[i] - hist.lo) * scale;
+            if (pos >= 0.0f && pos < limit) acc.bins[static_cast<uint32_t>(pos)]++;
+        }
+    }
+}
+
+// Maps a tile at a time so the reduction reads values still in L1, and a
+// read-only map never writes the source buffer.
+template <class Op, Reduce R>
+void cpuRange(float* data, size_t count, const Kernel& kernel, Partial& acc) {
+    constexpr size_t kTile = 1024;
+    if constexpr (R == Reduce::None) {
+        Op::block(data, count);
+    } else {
+        float tile[kTile];
+        for (size_t i = 0; i < count; i += kTile) {
+            size_t n = std::min(kTile, count - i);
+            float* values = data + i;
+            if (!kernel.writeBack() && !std::is_same<Op, Identity>::value) {
+                std::copy(values, values + n, tile);
+                values = tile;
+            }
+            Op::block(values, n);
+            accumulate<R>(values, n, kernel.histogram(), acc);
+        }
+    }
+}
+
+template <class Op>
+CpuRangeFn cpuRangeFor(Reduce reduce) {
+    switch (reduce) {
+    case Reduce::Sum: return cpuRange<Op, Reduce::Sum>;
+    case Reduce::Min: return cpuRange<Op, Reduce::Min>;
+    case Reduce::Max: return cpuRange<Op, Reduce::Max>;
+    case Reduce::Histogram: return cpuRange<Op, Reduce::Histogram>;
+    default: return cpuRange<Op, Reduce::None>;
+    }
+}
+
+}
+
+// Element-wise map, results written back.
+template <class Op>
+Kernel makeMap() {
+    return Kernel(Op::name, Op::glsl, detail::cpuRangeFor<Op>(Reduce::None), Reduce::None, true);
+}
+
+// Reduction over Op(x); the input buffer is left untouched.
+template <class Op = Identity>
+Kernel makeReduce(Reduce reduce, HistogramSpec histogram = {}) {
+    return Kernel(Op::name, Op::glsl, detail::cpuRangeFor<Op>(reduce), reduce, false, histogram);
+}
+
+// Map written back and reduced in the same pass.
+template <class Op>
+Kernel makeMapReduce(Reduce reduce, HistogramSpec histogram = {}) {
+    return Kernel(Op::name, Op::glsl, detail::cpuRangeFor<Op>(reduce), reduce, true, histogram);
+}
+
+}
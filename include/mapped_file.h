@@ -0,0 +1,62 @@
+#pragma once
+#include <cstddef>
+#include <string>
+
+// A whole file mapped into the address space. The OS pages it in on demand
+// and can drop clean pages again, so files larger than RAM are fine as long
+// as the caller only keeps a window of it hot (see advise()).
+class MappedFile {
+public:
+    enum class Mode {
+        Read,       // existing file, read-only
+        ReadWrite,  // existing file, writes go back to it
+        Create      // new or truncated file of the given size, read-write
+    };
+
+    enum class Advice {
+        Sequential,  // whole-file hint: aggressive readahead, early reclaim
+        WillNeed,    // start reading this range now
+        DontNeed     // done with this range; drop it from our resident set
+    };
+
+    MappedFile(const std::string& path, Mode mode, size_t size = 0);
+    ~MappedFile();
+
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    char* data() const { return base; }
+    size_t size() const { return length; }
+    bool writable() const { return mode != Mode::Read; }
+
+    // Hints for [offset, offset + bytes), clamped to the file; offset is
+    // rounded down to a page. A no-op where the OS has no equivalent.
+    void advise(Advice advice, size_t offset = 0, size_t bytes = 0);
+    // Starts writing dirty pages in the range back without waiting for them.
+    void flushAsync(size_t offset, size_t bytes);
+
+    static size_t pageSize();
+
+private:
+    void close();
+
+    std::string path;
+    Mode mode;
+    char* base = nullptr;
+    size_t length = 0;
+#ifdef _WIN32
+    void* file = nullptr;
+    void* mapping = nullptr;
+#else
+    int fd = -1;
+#endif
+};
+
+// Sequential read() throughput of the file into a small reused buffer: the
+// raw bandwidth a pass over the mapping is compared against. With
+// drop_cache, the file's clean pages are evicted first (POSIX only) so the
+// number reflects the device rather than the page cache.
+double measureReadBandwidthGBs(const std::string& path, bool drop_cache = false);
+
+// Evicts the file's clean pages from the page cache where supported.
+void dropFileCache(const std::string& path);
@@ -0,0 +1,120 @@
+#pragma once
+#include <cstdint>
+#include <string>
+#include <vector>
+
+#ifndef PS_ENABLE_METRICS
+#define PS_ENABLE_METRICS 1
+#endif
+
+// Hot-path counters and trace events for both backends.
+//
+// Every thread that records something gets its own block of atomic counters
+// (registered once, then only touched by that thread with relaxed adds), so
+// recording never takes a lock or shares a cache line. snapshot() sums the
+// blocks; chromeTrace() exports the spans recorded while tracing was on as
+// Chrome trace-event JSON (chrome://tracing, Perfetto).
+//
+// Built with PS_ENABLE_METRICS=0 (CMake option of the same name) every
+// recording call is an empty inline function and Scope is an empty object.
+namespace metrics {
+
+enum class Counter {
+    CpuBusyNs,          // pool threads (and helping callers) running ranges
+    CpuIdleNs,          // pool workers asleep waiting for work
+    CpuChunks,          // ranges run
+    CpuElements,        // elements in those ranges
+    GpuUploadNs,
+    GpuDispatchNs,
+    GpuSyncNs,          // blocked on fences
+    GpuMapNs,           // glMapBuffer* calls
+    GpuDownloadNs,
+    GpuUploadBytes,
+    GpuDownloadBytes,
+    GpuBufferReallocs,  // the buffer pool had to allocate storage
+    Count
+};
+
+constexpr size_t kCounters = static_cast<size_t>(Counter::Count);
+constexpr bool kEnabled = PS_ENABLE_METRICS != 0;
+
+const char* counterName(Counter counter);
+
+struct ThreadSnapshot {
+    std::string name;
+    uint64_t values[kCounters] = {};
+
+    uint64_t operator[](Counter c) const { return values[static_cast<size_t>(c)]; }
+};
+
+struct Snapshot {
+    uint64_t totals[kCounters] = {};
+    std::vector<ThreadSnapshot> threads;  // threads that recorded anything
+
+    uint64_t operator[](Counter c) const { return totals[static_cast<size_t>(c)]; }
+    // Busiest thread's CpuBusyNs over the mean of threads with any: 1.0 is a
+    // perfectly balanced pool.
+    double cpuImbalance() const;
+};
+
+#if PS_ENABLE_METRICS
+
+void add(Counter counter, uint64_t value);
+// Names the calling thread in snapshots and traces ("worker 3").
+void setThreadName(const std::string& name);
+
+// Trace spans are recorded only while tracing is on; counters always are.
+void setTracing(bool enabled);
+bool tracing();
+// Appends a complete span to the calling thread's trace ring (the oldest
+// events are overwritten once a thread has recorded kTraceCapacity).
+void traceSpan(const char* name, uint64_t start_ns, uint64_t end_ns);
+constexpr size_t kTraceCapacity = 1 << 16;
+
+uint64_t nowNs();
+
+// Adds its lifetime to a counter and, while tracing, records it as a span.
+class Scope {
+public:
+    Scope(Counter counter, const char* name) : counter(counter), name(name), start(nowNs()) {}
+    ~Scope() {
+        uint64_t end = nowNs();
+        add(counter, end - start);
+        if (tracing()) traceSpan(name, start, end);
+    }
+    Scope(const Scope&) = delete;
+    Scope& operator=(const Scope&) = delete;
+
+private:
+    Counter counter;
+    const char* name;
+    uint64_t start;
+};
+
+#else
+
+inline void add(Counter, uint64_t) {}
+inline void setThreadName(const std::string&) {}
+inline void setTracing(bool) {}
+inline bool tracing() { return false; }
+inline void traceSpan(const char*, uint64_t, uint64_t) {}
+constexpr size_t kTraceCapacity = 0;
+inline uint64_t nowNs() { return 0; }
+
+class Scope {
+public:
+    Scope(Counter, const char*) {}
+};
+
+#endif
+
+// Sums every thread's counters (all zero when compiled out).
+Snapshot snapshot();
+// Zeroes all counters and drops recorded trace events.
+void reset();
+// {"traceEvents": [...]} with one complete ("X") event per span.
+std::string chromeTrace();
+// Returns false if the file can't be written.
+bool writeChromeTrace(const std::string& path);
+
+}
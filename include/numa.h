@@ -0,0 +1,35 @@
+#pragma once
+#include <thread>
+#include <vector>
+
+// Machine topology and thread placement, read from sysfs on Linux. Anything
+// that can't be determined (other OSes, containers without sysfs) collapses
+// to a single node holding every CPU, and pinning becomes a no-op that
+// reports failure, so callers never need a NUMA-specific code path.
+namespace numa {
+
+struct Topology {
+    // CPUs of each memory node, restricted to the process affinity mask.
+    // Nodes without usable CPUs are left out.
+    std::vector<std::vector<unsigned>> node_cpus;
+
+    unsigned nodes() const { return static_cast<unsigned>(node_cpus.size()); }
+    unsigned cpus() const;
+    bool isNuma() const { return node_cpus.size() > 1; }
+};
+
+// Detected once on first use.
+const Topology& topology();
+
+// CPU for worker `index` of `count`: workers are split into contiguous
+// blocks, one per node and sized to the node's share of CPUs, so a range
+// partitioned by worker index is also partitioned by node.
+unsigned cpuForWorker(unsigned index, unsigned count);
+// Node that cpuForWorker(index, count) belongs to.
+unsigned nodeForWorker(unsigned index, unsigned count);
+
+// Pins a thread to one CPU. Returns false where unsupported or refused
+// (e.g. the CPU is outside a cgroup's cpuset).
+bool pinThread(std::thread& thread, unsigned cpu);
+
+}
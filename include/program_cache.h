@@ -0,0 +1,68 @@
+#pragma once
+#include <GL/glew.h>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+// Linked compute programs for one GL context, built once per source.
+//
+// With a directory, each program is also saved there through
+// glGetProgramBinary, under a hash of its source and the driver (vendor,
+// renderer, version) with the full source and driver stored alongside, and
+// later runs whose source and driver match exactly relink it with
+// glProgramBinary instead of compiling GLSL. A binary the driver rejects is recompiled and replaced,
+// and disk errors only cost the compile, so the directory is safe to delete
+// or share between processes.
+class ProgramCache {
+public:
+    struct Program {
+        GLuint id = 0;
+        // Resolved once at link time; -1 when the shader doesn't use it
+        // (glUniform* ignores -1).
+        GLint groups_x = -1;
+        GLint count = -1;
+        GLint hist_lo = -1;
+        GLint hist_scale = -1;
+        GLint hist_bins = -1;
+        GLint arrays = -1;
+    };
+
+    struct Stats {
+        size_t compiled = 0;     // built from GLSL
+        size_t loaded = 0;       // relinked from a binary on disk
+        size_t reused = 0;       // already built in this context
+        size_t stored = 0;       // binaries written to disk
+    };
+
+    // An empty directory keeps programs in memory only.
+    explicit ProgramCache(std::string directory = defaultDirectory());
+    ProgramCache(const ProgramCache&) = delete;
+    ProgramCache& operator=(const ProgramCache&) = delete;
+
+    // Needs the owning context current. Throws std::runtime_error with the
+    // compiler or linker log when the source doesn't build.
+    const Program& get(const std::string& source);
+    // Deletes every program; needs the owning context current.
+    void clear();
+
+    const std::string& directory() const { return g_directory; }
+    const Stats& stats() const { return g_stats; }
+
+    // $PS_SHADER_CACHE when set (empty disables the disk cache), otherwise
+    // ps-shaders under the user's cache directory (XDG_CACHE_HOME, ~/.cache,
+    // or LOCALAPPDATA on Windows).
+    static std::string defaultDirectory();
+
+private:
+    // key is the driver and source; files are named by its hash and store
+    // it in full.
+    std::string binaryPath(const std::string& key);
+    GLuint loadBinary(const std::string& path, const std::string& key);
+    void storeBinary(const std::string& path, const std::string& key, GLuint program);
+
+    std::string g_directory;
+    std::string g_driver;  // vendor/renderer/version, read on first use
+    bool g_binaries_supported = false;
+    std::unordered_map<std::string, Program> g_programs;
+    Stats g_stats;
+};
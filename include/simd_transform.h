@@ -0,0 +1,37 @@
+#pragma once
+#include <cstddef>
+
+// Vectorized x = sqrt(x) + sin(x) * cos(x) + exp(-x * 0.001f).
+//
+// sin(x)*cos(x) is evaluated as 0.5f * sin(2x) with one Cody-Waite reduction
+// and minimax sin/cos polynomials, exp() with a degree-5 polynomial scaled by
+// 2^n. Against a double-precision reference the result is within 2 ULP for
+// 0 <= x <= 32768 on every level (see CpuTest.SimdAccuracySweep). Lanes with
+// x > 32768 fall back to libm for that element, so larger inputs keep the
+// accuracy of the scalar formula. Negative inputs give NaN, as std::sqrt does.
+namespace simd {
+
+enum class Level {
+    Scalar,
+    SSE2,
+    AVX2,   // AVX2 + FMA + F16C
+    AVX512  // AVX-512F
+};
+
+// Best level this CPU and build support.
+Level detectLevel();
+
+// Level used by transform(). Defaults to detectLevel().
+Level activeLevel();
+
+// Forces a level, clamped to detectLevel(). Meant for tests and benchmarks.
+void setLevel(Level level);
+
+const char* levelName(Level level);
+
+void transform(float* data, size_t count);
+
+// Reference formula with libm, one element at a time.
+float transformScalar(float x);
+
+}
@@ -0,0 +1,131 @@
+#pragma once
+#include <atomic>
+#include <condition_variable>
+#include <cstddef>
+#include <deque>
+#include <exception>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+// Long-lived pool of worker threads with one deque per worker.
+// parallelFor() splits a range lazily: a worker takes a range, pushes the upper
+// half back onto its own deque until the remainder is at most `grain` elements,
+// and runs it. Idle workers steal the oldest (largest) range from other deques,
+// so a slow core never holds up the rest of the batch.
+class ThreadPool {
+    struct Job;
+
+public:
+    using RangeFn = std::function<void(size_t begin, size_t end)>;
+
+    // Handle to work started with submit(). Destroying an unfinished batch
+    // waits for it (dropping any exception); call wait() to see errors.
+    class Batch {
+    public:
+        Batch() = default;
+        Batch(Batch&& other) noexcept = default;
+        Batch& operator=(Batch&& other) noexcept;
+        ~Batch();
+
+        // True once every range has run; never blocks.
+        bool ready() const;
+        // Helps run queued ranges until this batch is done, then rethrows the
+        // first exception thrown by fn. No-op on an empty or waited batch.
+        void wait();
+
+    private:
+        friend class ThreadPool;
+        Batch(ThreadPool* pool, std::shared_ptr<Job> job) : pool(pool), job(std::move(job)) {}
+
+        ThreadPool* pool = nullptr;
+        std::shared_ptr<Job> job;
+    };
+
+    enum class Affinity {
+        None,   // let the OS schedule workers
+        Spread  // pin worker i to numa::cpuForWorker(i, size()): one core each,
+                // contiguous blocks of workers per node
+    };
+
+    // num_threads == 0 uses std::thread::hardware_concurrency().
+    explicit ThreadPool(unsigned num_threads = 0, Affinity affinity = Affinity::None);
+    ~ThreadPool();
+
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    // Runs fn over [begin, end) in ranges of at most `grain` elements and
+    // blocks until all of them are done. The calling thread helps out while
+    // it waits. The first exception thrown by fn is rethrown here.
+    void parallelFor(size_t begin, size_t end, size_t grain, const RangeFn& fn);
+
+    // Same split as parallelFor, but returns as soon as the ranges are queued.
+    // fn is copied into the batch.
+    Batch submit(size_t begin, size_t end, size_t grain, RangeFn fn);
+
+    // Splits [begin, end) into size() equal slices and runs slice i on worker i
+    // (never stolen; run by the caller only when it is worker i itself), then
+    // blocks until all are done.
+    // For a range of at least size() * grain elements the slices are the ones
+    // parallelFor/submit seed each worker with, which makes this the way to
+    // first-touch memory on the node that will later process it.
+    void forEachWorker(size_t begin, size_t end, const RangeFn& fn);
+
+    unsigned size() const { return static_cast<unsigned>(workers.size()); }
+    Affinity affinity() const { return placement; }
+    // Workers that were successfully pinned; 0 with Affinity::None or when
+    // the OS refused.
+    unsigned pinnedWorkers() const { return pinned; }
+
+    // Process-wide pool sized to the machine, created on first use.
+    static std::shared_ptr<ThreadPool> shared();
+
+private:
+    struct Job {
+        RangeFn fn;
+        size_t grain = 1;
+        std::atomic<size_t> remaining{0};
+        std::mutex m;
+        std::condition_variable cv;
+        bool done = false;
+        std::atomic<bool> failed{false};
+        std::exception_ptr error;
+    };
+
+    struct Task {
+        size_t begin = 0;
+        size_t end = 0;
+        Job* job = nullptr;
+        bool pinned = false;  // only the owning worker may run it
+    };
+
+    struct Worker {
+        std::mutex m;
+        std::deque<Task> tasks;
+        std::atomic<size_t> pinned_tasks{0};
+    };
+
+    void enqueue(Job* job, size_t begin, size_t end);
+    void help(Job& job);
+    void workerLoop(unsigned index);
+    void push(unsigned index, const Task& task, bool wake = true);
+    bool popLocal(unsigned index, Task& task);
+    bool steal(unsigned thief, Task& task);
+    void runTask(unsigned home, Task task);
+    void finish(Job* job, size_t count);
+
+    std::vector<std::unique_ptr<Worker>> workers;
+    std::vector<std::thread> threads;
+
+    Affinity placement;
+    unsigned pinned = 0;
+    std::atomic<size_t> queued{0};  // stealable tasks; pinned ones are counted per Worker
+    std::atomic<unsigned> sleeping{0};
+    std::atomic<unsigned> next_home{0};
+    std::mutex sleep_mutex;
+    std::condition_variable sleep_cv;
+    bool stopping = false;
+};
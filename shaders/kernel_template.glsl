@@ -0,0 +1,169 @@
+// Body shared by every kernel ComputeGPU::run builds. ComputeGPU prepends the
+// #version line, the REDUCE_OP / WRITE_BACK / STORAGE / BATCHED defines and
+// the kernel's mapValue(inout float x) before compiling.
+
+layout(local_size_x = 256) in;
+
+// F32 holds one float per element. F16 / BF16 pack two elements per uint,
+// low half first, and each invocation handles the pair.
+#if STORAGE == STORAGE_F32
+#define PER_INVOCATION 1u
+layout(std430, binding = 0) buffer Data {
+    float data[];
+};
+#else
+#define PER_INVOCATION 2u
+layout(std430, binding = 0) buffer Data {
+    uint data[];
+};
+#endif
+
+// One value per workgroup for Sum / Min / Max; finished on the CPU.
+layout(std430, binding = 1) buffer Partials {
+    float partials[];
+};
+
+// u_HistBins per array.
+layout(std430, binding = 2) buffer Bins {
+    uint bins[];
+};
+
+#if BATCHED
+// Array i covers elements [segments[2i], segments[2i] + segments[2i + 1]).
+// Starts are multiples of a workgroup's elements, so no workgroup (and no
+// packed pair) spans two arrays; after the u_Arrays pairs comes the array
+// each workgroup belongs to.
+layout(std430, binding = 3) readonly buffer Segments {
+    uint segments[];
+};
+uniform uint u_Arrays;
+#endif
+
+uniform uint u_GroupsX;  // The X-dimension workgroup count passed from C++
+uniform uint u_Count;    // Elements in data[]; the buffer may be larger
+uniform float u_HistLo;
+uniform float u_HistScale; // bins / (hi - lo)
+uniform uint u_HistBins;
+
+#if STORAGE == STORAGE_F16
+vec2 unpackPair(uint w) {
+    return unpackHalf2x16(w);
+}
+
+uint packPair(vec2 v) {
+    return packHalf2x16(v);
+}
+#elif STORAGE == STORAGE_BF16
+vec2 unpackPair(uint w) {
+    return vec2(uintBitsToFloat(w << 16), uintBitsToFloat(w & 0xffff0000u));
+}
+
+// Same rounding as toBFloat16 on the CPU.
+uint bf16Bits(float x) {
+    uint b = floatBitsToUint(x);
+    if (isnan(x)) return (b >> 16) | 0x40u;
+    return (b + 0x7fffu + ((b >> 16) & 1u)) >> 16;
+}
+
+uint packPair(vec2 v) {
+    return bf16Bits(v.x) | (bf16Bits(v.y) << 16);
+}
+#endif
+
+#if REDUCE_OP == REDUCE_SUM || REDUCE_OP == REDUCE_MIN || REDUCE_OP == REDUCE_MAX
+#define REDUCE_IN_GROUP 1
+shared float s_partial[256];
+
+float reduceIdentity() {
+#if REDUCE_OP == REDUCE_SUM
+    return 0.0;
+#elif REDUCE_OP == REDUCE_MIN
+    return uintBitsToFloat(0x7f800000u);
+#else
+    return uintBitsToFloat(0xff800000u);
+#endif
+}
+
+float reduceCombine(float a, float b) {
+#if REDUCE_OP == REDUCE_SUM
+    return a + b;
+#elif REDUCE_OP == REDUCE_MIN
+    return min(a, b);
+#else
+    return max(a, b);
+#endif
+}
+#endif
+
+void addToHistogram(float x, uint first_bin) {
+#if REDUCE_OP == REDUCE_HISTOGRAM
+    // Same arithmetic as kernels::detail::accumulate.
+    float pos = (x - u_HistLo) * u_HistScale;
+    if (pos >= 0.0 && pos < float(u_HistBins)) atomicAdd(bins[first_bin + uint(pos)], 1u);
+#endif
+}
+
+void main() {
+    // Same 2D -> 1D mapping as compute_shader.glsl.
+    uint total_threads_in_x_slice = u_GroupsX * gl_WorkGroupSize.x;
+    uint idx_1D = gl_GlobalInvocationID.x +
+                  (gl_GlobalInvocationID.y * total_threads_in_x_slice);
+
+    // This invocation's first element, relative to the start of its array.
+    uint element = idx_1D * PER_INVOCATION;
+#if BATCHED
+    // Workgroups past the table only exist to round up the 2D grid; they
+    // fall outside the last array.
+    uint entry = 2u * u_Arrays + gl_WorkGroupID.x + gl_WorkGroupID.y * u_GroupsX;
+    uint array_index = entry < uint(segments.length()) ? segments[entry] : u_Arrays - 1u;
+    element -= segments[2u * array_index];
+    uint count = segments[2u * array_index + 1u];
+    uint first_bin = array_index * u_HistBins;
+#else
+    uint count = u_Count;
+    uint first_bin = 0u;
+#endif
+
+    bool in_range = element < count;
+    float x = 0.0;
+    if (in_range) {
+#if STORAGE == STORAGE_F32
+        x = data[idx_1D];
+        mapValue(x);
+#if WRITE_BACK
+        data[idx_1D] = x;
+#endif
+        addToHistogram(x, first_bin);
+#else
+        uint word = data[idx_1D];
+        vec2 pair = unpackPair(word);
+        bool second = element + 1u < count;
+        mapValue(pair.x);
+        addToHistogram(pair.x, first_bin);
+        x = pair.x;
+        if (second) {
+            mapValue(pair.y);
+            addToHistogram(pair.y, first_bin);
+#ifdef REDUCE_IN_GROUP
+            x = reduceCombine(x, pair.y);
+#endif
+        }
+#if WRITE_BACK
+        // An odd count leaves the last word's high half as padding; keep it.
+        uint mapped = packPair(pair);
+        data[idx_1D] = second ? mapped : (mapped & 0xffffu) | (word & 0xffff0000u);
+#endif
+#endif
+    }
+
+#ifdef REDUCE_IN_GROUP
+    uint lid = gl_LocalInvocationIndex;
+    s_partial[lid] = in_range ? x : reduceIdentity();
+    barrier();
+    for (uint stride = gl_WorkGroupSize.x / 2u; stride > 0u; stride >>= 1) {
+        if (lid < stride) s_partial[lid] = reduceCombine(s_partial[lid], s_partial[lid + stride]);
+        barrier();
+    }
+    if (lid == 0u) partials[gl_WorkGroupID.x + gl_WorkGroupID.y * u_GroupsX] = s_partial[0];
+#endif
+}
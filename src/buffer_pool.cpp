@@ -0,0 +1,71 @@
+#include "buffer_pool.h"
+#include "metrics.h"
+
+size_t BufferPool::bucketFor(size_t bytes) {
+    size_t capacity = kMinBytes;
+    while (capacity < bytes && capacity < kFineBytes) capacity *= 2;
+    if (capacity >= bytes) return capacity;
+
+    // Largest power of two below bytes, then up to the next eighth of it.
+    while (capacity * 2 < bytes) capacity *= 2;
+    size_t step = capacity / 8;
+    return (bytes + step - 1) / step * step;
+}
+
+BufferPool::Buffer BufferPool::acquire(size_t bytes) {
+    Buffer buffer;
+    buffer.capacity = bucketFor(bytes);
+
+    auto it = g_free.find(buffer.capacity);
+    if (it != g_free.end() && !it->second.empty()) {
+        buffer.id = it->second.back();
+        it->second.pop_back();
+        g_stats.idle_bytes -= buffer.capacity;
+        g_stats.reused++;
+        return buffer;
+    }
+
+    metrics::add(metrics::Counter::GpuBufferReallocs, 1);
+    glGenBuffers(1, &buffer.id);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.id);
+    glBufferData(GL_SHADER_STORAGE_BUFFER, static_cast<GLsizeiptr>(buffer.capacity), nullptr, GL_DYNAMIC_COPY);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    g_stats.allocated++;
+    return buffer;
+}
+
+void BufferPool::release(Buffer& buffer) {
+    if (!buffer.id) return;
+    g_free[buffer.capacity].push_back(buffer.id);
+    g_stats.idle_bytes += buffer.capacity;
+    buffer = Buffer();
+    trim();
+}
+
+bool BufferPool::reserve(Buffer& buffer, size_t bytes) {
+    if (buffer.id && buffer.capacity >= bytes) return false;
+    Buffer bigger = acquire(bytes);
+    release(buffer);
+    buffer = bigger;
+    return true;
+}
+
+void BufferPool::clear() {
+    for (auto& entry : g_free) {
+        if (!entry.second.empty()) glDeleteBuffers(static_cast<GLsizei>(entry.second.size()), entry.second.data());
+    }
+    g_free.clear();
+    g_stats.idle_bytes = 0;
+}
+
+void BufferPool::trim() {
+    // Largest first: they hold the most memory.
+    for (auto it = g_free.rbegin(); it != g_free.rend() && g_stats.idle_bytes > max_idle_bytes; ++it) {
+        std::vector<GLuint>& ids = it->second;
+        while (!ids.empty() && g_stats.idle_bytes > max_idle_bytes) {
+            glDeleteBuffers(1, &ids.back());
+            ids.pop_back();
+            g_stats.idle_bytes -= it->first;
+        }
+    }
+}
@@ -0,0 +1,55 @@
+#include "completion.h"
+
+namespace {
+
+struct Done : Completion::State {
+    bool poll() override { return true; }
+    void wait() override {}
+};
+
+struct All : Completion::State {
+    std::vector<Completion> handles;
+
+    bool poll() override {
+        // Poll every handle, not just up to the first pending one, so GPU
+        // jobs behind a slow CPU batch still get read back early.
+        bool all = true;
+        for (const Completion& c : handles) all = c.ready() && all;
+        return all;
+    }
+
+    void wait() override {
+        for (const Completion& c : handles) {
+            try {
+                c.wait();
+            } catch (...) {
+                if (!error) error = std::current_exception();
+            }
+        }
+    }
+};
+
+}
+
+Completion Completion::completed(kernels::Result result) {
+    auto done = std::make_shared<Done>();
+    done->result = std::move(result);
+    return Completion(std::move(done));
+}
+
+void Completion::wait() const {
+    if (!state) return;
+    state->wait();
+    if (state->error) std::rethrow_exception(state->error);
+}
+
+kernels::Result Completion::get() const {
+    wait();
+    return state ? state->result : kernels::Result();
+}
+
+Completion whenAll(std::vector<Completion> handles) {
+    auto all = std::make_shared<All>();
+    all->handles = std::move(handles);
+    return Completion(std::move(all));
+}
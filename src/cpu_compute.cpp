@@ -1,30 +1,195 @@
 #include "cpu_compute.h"
+#include "simd_transform.h"
 #include <vector>
-#include <thread>
-#include <cmath>
 #include <algorithm>
-#include <iostream>
-
-void ComputeCPU::process(std::vector<float>& data) {
-    auto worker = [&](size_t start, size_t end) {
-        for (size_t i = start; i < end; i++) {
-            float &x = data[i];
-            // Example computation x = 64 -> f(x) = 9.298
-            x = std::sqrt(x) + std::sin(x) * std::cos(x) + std::exp(-x * 0.001f); 
-        }
+#include <atomic>
+#include <mutex>
+#include <stdexcept>
+
+ComputeCPU::ComputeCPU(unsigned num_threads, size_t grain_size)
+    : pool(num_threads == 0 ? ThreadPool::shared() : std::make_shared<ThreadPool>(num_threads)) {
+    setGrainSize(grain_size);
+}
+
+ComputeCPU::ComputeCPU(std::shared_ptr<ThreadPool> pool, size_t grain_size)
+    : pool(std::move(pool)) {
+    if (!this->pool) throw std::runtime_error("ComputeCPU requires a thread pool.");
+    setGrainSize(grain_size);
+}
+
+void ComputeCPU::setGrainSize(size_t grain_size) {
+    if (grain_size == 0) throw std::runtime_error("Grain size must be greater than zero.");
+    grain = grain_size;
+}
+
+FloatBuffer ComputeCPU::allocate(size_t count, float value) const {
+    FloatBuffer buffer(count);
+    float* ptr = buffer.data();
+    pool->forEachWorker(0, count, [ptr, value](size_t start, size_t end) {
+        std::fill(ptr + start, ptr + end, value);
+    });
+    return buffer;
+}
+
+void ComputeCPU::process(FloatSpan data) {
+    if (!data.contiguous()) {
+        run(kernels::makeMap<kernels::Transform>(), data);
+        return;
+    }
+
+    float* ptr = data.data();
+    auto worker = [ptr](size_t start, size_t end) {
+        simd::transform(ptr + start, end - start);
     };
 
-    size_t n = data.size();
-    unsigned int num_threads = std::thread::hardware_concurrency(); 
-    size_t chunk = n / num_threads;
+    pool->parallelFor(0, data.size(), grain, worker);
+}
+
+namespace {
+
+// Converts through a float tile: strided float spans, and every 16-bit one.
+template <class T>
+void runTiled(const kernels::Kernel& kernel, StridedSpan<T> data, size_t start, size_t end, kernels::Partial& acc) {
+    constexpr size_t kTile = 1024;
+    float tile[kTile];
+    for (size_t i = start; i < end; i += kTile) {
+        size_t n = std::min(kTile, end - i);
+        gatherSpan(data, i, n, tile);
+        kernel.runCpu(tile, n, acc);
+        if (kernel.writeBack()) scatterSpan(tile, n, data, i);
+    }
+}
+
+void runRangeOf(const kernels::Kernel& kernel, FloatSpan data, size_t start, size_t end, kernels::Partial& acc) {
+    ComputeCPU::runRange(kernel, data, start, end, acc);
+}
+
+template <class T>
+void runRangeOf(const kernels::Kernel& kernel, StridedSpan<T> data, size_t start, size_t end, kernels::Partial& acc) {
+    runTiled(kernel, data, start, end, acc);
+}
+
+}
+
+void ComputeCPU::runRange(const kernels::Kernel& kernel, FloatSpan data, size_t start, size_t end,
+                          kernels::Partial& acc) {
+    if (data.contiguous()) {
+        kernel.runCpu(data.data() + start, end - start, acc);
+        return;
+    }
+    runTiled(kernel, data, start, end, acc);
+}
+
+template <class T>
+kernels::Result ComputeCPU::runSpan(const kernels::Kernel& kernel, StridedSpan<T> data) {
+    if (kernel.reduce() == kernels::Reduce::None) {
+        pool->parallelFor(0, data.size(), grain, [&](size_t start, size_t end) {
+            kernels::Partial unused;
+            runRangeOf(kernel, data, start, end, unused);
+        });
+        return {};
+    }
+
+    kernels::Partial total;
+    std::mutex total_mutex;
+    pool->parallelFor(0, data.size(), grain, [&](size_t start, size_t end) {
+        kernels::Partial partial;
+        runRangeOf(kernel, data, start, end, partial);
+        std::lock_guard<std::mutex> lk(total_mutex);
+        total.merge(partial);
+    });
+    return kernel.finish(total);
+}
+
+kernels::Result ComputeCPU::run(const kernels::Kernel& kernel, FloatSpan data) {
+    return runSpan(kernel, data);
+}
 
-    std::vector<std::thread> threads;
+kernels::Result ComputeCPU::run(const kernels::Kernel& kernel, HalfSpan data) {
+    return runSpan(kernel, data);
+}
+
+kernels::Result ComputeCPU::run(const kernels::Kernel& kernel, BFloat16Span data) {
+    return runSpan(kernel, data);
+}
+
+std::vector<kernels::Result> ComputeCPU::runBatch(const kernels::Kernel& kernel, const std::vector<FloatSpan>& arrays) {
+    // offsets[a] is where array a starts in the combined index space.
+    std::vector<size_t> offsets(arrays.size() + 1, 0);
+    for (size_t a = 0; a < arrays.size(); a++) offsets[a + 1] = offsets[a] + arrays[a].size();
+
+    bool reduce = kernel.reduce() != kernels::Reduce::None;
+    std::vector<kernels::Partial> totals(arrays.size());
+    std::mutex total_mutex;
+    pool->parallelFor(0, offsets.back(), grain, [&](size_t start, size_t end) {
+        // Last array starting at or before start; skips empty ones.
+        size_t a = std::upper_bound(offsets.begin(), offsets.end(), start) - offsets.begin() - 1;
+        for (; start < end; a++) {
+            size_t stop = std::min(end, offsets[a + 1]);
+            kernels::Partial partial;
+            runRange(kernel, arrays[a], start - offsets[a], stop - offsets[a], partial);
+            if (reduce) {
+                std::lock_guard<std::mutex> lk(total_mutex);
+                totals[a].merge(partial);
+            }
+            start = stop;
+        }
+    });
 
-    for (unsigned int t = 0; t < num_threads; t++) {
-        size_t start = t * chunk;
-        size_t end = (t == num_threads - 1) ? n : start + chunk;
-        threads.emplace_back(worker, start, end);
+    std::vector<kernels::Result> results(arrays.size());
+    if (reduce) {
+        for (size_t a = 0; a < arrays.size(); a++) results[a] = kernel.finish(totals[a]);
+    }
+    return results;
+}
+
+namespace {
+
+struct CpuJob : Completion::State {
+    kernels::Kernel kernel;
+    kernels::Partial total;
+    std::mutex total_mutex;
+    std::mutex wait_mutex;
+    ThreadPool::Batch batch;
+    std::atomic<bool> done{false};  // result / error are set
+
+    explicit CpuJob(const kernels::Kernel& kernel) : kernel(kernel) {}
+
+    // wait() holds wait_mutex for the whole batch; while another thread is
+    // in there, the job isn't ready yet.
+    bool poll() override {
+        if (done.load(std::memory_order_acquire)) return true;
+        std::unique_lock<std::mutex> lk(wait_mutex, std::try_to_lock);
+        return lk.owns_lock() && batch.ready();
     }
 
-    for (auto& th : threads) th.join();
+    void wait() override {
+        std::lock_guard<std::mutex> lk(wait_mutex);
+        if (done.load(std::memory_order_relaxed)) return;
+        try {
+            batch.wait();
+            if (kernel.reduce() != kernels::Reduce::None) result = kernel.finish(total);
+        } catch (...) {
+            error = std::current_exception();
+        }
+        done.store(true, std::memory_order_release);
+    }
+};
+
+}
+
+Completion ComputeCPU::submit(const kernels::Kernel& kernel, FloatSpan data) {
+    auto job = std::make_shared<CpuJob>(kernel);
+    CpuJob* state = job.get();
+    // The batch lives inside the job, so the pool's copy of this lambda
+    // holds a raw pointer; the job outlives the batch by construction.
+    job->batch = pool->submit(0, data.size(), grain, [state, data](size_t start, size_t end) {
+        kernels::Partial partial;
+        runRange(state->kernel, data, start, end, partial);
+        if (state->kernel.reduce() != kernels::Reduce::None) {
+            std::lock_guard<std::mutex> lk(state->total_mutex);
+            state->total.merge(partial);
+        }
+    });
+    return Completion(std::move(job));
 }
@@ -0,0 +1,66 @@
+#include "file_processor.h"
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+FileStats processFile(ICompute& compute, const kernels::Kernel& kernel, const std::string& input,
+                      const std::string& output, const FileOptions& options) {
+    using Advice = MappedFile::Advice;
+    bool in_place = kernel.writeBack() && output.empty();
+    if (!kernel.writeBack() && !output.empty()) {
+        throw std::runtime_error("Kernel " + kernel.name() + " does not write back; no output file is produced.");
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    MappedFile in(input, in_place ? MappedFile::Mode::ReadWrite : MappedFile::Mode::Read);
+    if (in.size() % sizeof(float) != 0) {
+        throw std::runtime_error(input + " is not a whole number of floats.");
+    }
+
+    std::unique_ptr<MappedFile> out;
+    if (kernel.writeBack() && !in_place) {
+        out = std::make_unique<MappedFile>(output, MappedFile::Mode::Create, in.size());
+    }
+    MappedFile& target = out ? *out : in;
+
+    size_t page = MappedFile::pageSize();
+    size_t window = std::max(options.window_bytes, page);
+    window = (window + page - 1) / page * page;
+
+    FileStats stats;
+    stats.bytes = in.size();
+    in.advise(Advice::Sequential);
+    in.advise(Advice::WillNeed, 0, window * (1 + options.readahead_windows));
+
+    bool have_result = false;
+    for (size_t offset = 0; offset < in.size(); offset += window) {
+        size_t bytes = std::min(window, in.size() - offset);
+        // Keep readahead_windows in flight ahead of the one being processed.
+        in.advise(Advice::WillNeed, offset + window * (1 + options.readahead_windows), window);
+
+        if (out) std::memcpy(out->data() + offset, in.data() + offset, bytes);
+        FloatSpan span(reinterpret_cast<float*>(target.data() + offset), bytes / sizeof(float));
+        kernels::Result r = compute.run(kernel, span);
+        if (kernel.reduce() != kernels::Reduce::None) {
+            stats.result = have_result ? kernel.merge(stats.result, r) : r;
+            have_result = true;
+        }
+
+        if (kernel.writeBack()) target.flushAsync(offset, bytes);
+        in.advise(Advice::DontNeed, offset, bytes);
+        if (out) out->advise(Advice::DontNeed, offset, bytes);
+        stats.windows++;
+    }
+
+    if (!have_result && kernel.reduce() != kernels::Reduce::None) stats.result = kernel.finish(kernels::Partial());
+    stats.total_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return stats;
+}
+
+FileStats processFile(ICompute& compute, const std::string& input, const std::string& output,
+                      const FileOptions& options) {
+    return processFile(compute, kernels::makeMap<kernels::Transform>(), input, output, options);
+}
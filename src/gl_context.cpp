@@ -0,0 +1,189 @@
+#include "gl_context.h"
+#include <cstring>
+#include <mutex>
+#include <stdexcept>
+
+#ifdef PS_HAVE_EGL
+#include <EGL/egl.h>
+#include <EGL/eglext.h>
+
+#ifndef EGL_PLATFORM_SURFACELESS_MESA
+#define EGL_PLATFORM_SURFACELESS_MESA 0x31DD
+#endif
+#ifndef EGL_NO_CONFIG_KHR
+#define EGL_NO_CONFIG_KHR ((EGLConfig)0)
+#endif
+#endif
+
+namespace {
+
+#ifdef PS_HAVE_EGL
+
+// eglTerminate tears down every context on the display, so it is shared and
+// terminated only when the last GLContext using it goes away.
+std::mutex g_egl_mutex;
+EGLDisplay g_egl_display = EGL_NO_DISPLAY;
+unsigned g_egl_users = 0;
+
+bool hasExtension(const char* list, const char* name) {
+    if (!list) return false;
+    size_t len = std::strlen(name);
+    for (const char* p = std::strstr(list, name); p; p = std::strstr(p + len, name)) {
+        if ((p == list || p[-1] == ' ') && (p[len] == ' ' || p[len] == '\0')) return true;
+    }
+    return false;
+}
+
+EGLDisplay openEglDisplay() {
+    const char* client = eglQueryString(EGL_NO_DISPLAY, EGL_EXTENSIONS);
+    if (hasExtension(client, "EGL_MESA_platform_surfaceless") && hasExtension(client, "EGL_EXT_platform_base")) {
+        auto getPlatformDisplay =
+            reinterpret_cast<PFNEGLGETPLATFORMDISPLAYEXTPROC>(eglGetProcAddress("eglGetPlatformDisplayEXT"));
+        if (getPlatformDisplay) {
+            EGLDisplay display = getPlatformDisplay(EGL_PLATFORM_SURFACELESS_MESA, EGL_DEFAULT_DISPLAY, nullptr);
+            if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) return display;
+        }
+    }
+    EGLDisplay display = eglGetDisplay(EGL_DEFAULT_DISPLAY);
+    if (display != EGL_NO_DISPLAY && eglInitialize(display, nullptr, nullptr)) return display;
+    return EGL_NO_DISPLAY;
+}
+
+// Called with g_egl_mutex held.
+void terminateUnusedDisplay() {
+    if (g_egl_users > 0 || g_egl_display == EGL_NO_DISPLAY) return;
+    eglTerminate(g_egl_display);
+    g_egl_display = EGL_NO_DISPLAY;
+}
+
+#endif
+
+// glfwTerminate destroys every window, so GLFW is likewise initialized by
+// the first GLContext using it and terminated by the last.
+std::mutex g_glfw_mutex;
+unsigned g_glfw_users = 0;
+
+// Called with g_glfw_mutex held.
+void releaseGlfw() {
+    if (--g_glfw_users == 0) glfwTerminate();
+}
+
+}
+
+GLContext::GLContext() {
+    if (!createEgl()) createGlfw();
+
+    // A GLEW built for GLX loads the GL entry points, then fails looking for
+    // an X display it doesn't need under EGL.
+    GLenum status = glewInit();
+    if (status != GLEW_OK && !(g_api == Api::Egl && status == GLEW_ERROR_NO_GLX_DISPLAY)) {
+        destroy();
+        throw std::runtime_error("Failed to initialize GLEW");
+    }
+}
+
+GLContext::~GLContext() {
+    destroy();
+}
+
+bool GLContext::createEgl() {
+#ifdef PS_HAVE_EGL
+    std::lock_guard<std::mutex> lock(g_egl_mutex);
+    if (g_egl_display == EGL_NO_DISPLAY) g_egl_display = openEglDisplay();
+    if (g_egl_display == EGL_NO_DISPLAY) return false;
+
+    // No surface is ever made current: skip the config where the driver
+    // allows it, otherwise any pbuffer-capable GL config will do (the default
+    // EGL_WINDOW_BIT matches nothing on surfaceless displays).
+    EGLConfig config = EGL_NO_CONFIG_KHR;
+    bool configless = hasExtension(eglQueryString(g_egl_display, EGL_EXTENSIONS), "EGL_KHR_no_config_context");
+    const EGLint config_attribs[] = {EGL_SURFACE_TYPE, EGL_PBUFFER_BIT, EGL_RENDERABLE_TYPE, EGL_OPENGL_BIT, EGL_NONE};
+    EGLint configs = 0;
+    if (!eglBindAPI(EGL_OPENGL_API) ||
+        (!configless && (!eglChooseConfig(g_egl_display, config_attribs, &config, 1, &configs) || configs < 1))) {
+        terminateUnusedDisplay();
+        return false;
+    }
+
+    const EGLint context_attribs[] = {
+        EGL_CONTEXT_MAJOR_VERSION, 4,
+        EGL_CONTEXT_MINOR_VERSION, 3,
+        EGL_CONTEXT_OPENGL_PROFILE_MASK, EGL_CONTEXT_OPENGL_CORE_PROFILE_BIT,
+        EGL_NONE};
+    EGLContext context = eglCreateContext(g_egl_display, config, EGL_NO_CONTEXT, context_attribs);
+    if (context != EGL_NO_CONTEXT &&
+        !eglMakeCurrent(g_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, context)) {
+        eglDestroyContext(g_egl_display, context);
+        context = EGL_NO_CONTEXT;
+    }
+    if (context == EGL_NO_CONTEXT) {
+        terminateUnusedDisplay();
+        return false;
+    }
+
+    g_egl_users++;
+    g_egl_context = context;
+    g_api = Api::Egl;
+    return true;
+#else
+    return false;
+#endif
+}
+
+void GLContext::createGlfw() {
+    std::lock_guard<std::mutex> lock(g_glfw_mutex);
+    if (g_glfw_users == 0 && !glfwInit()) {
+        throw std::runtime_error("Failed to initialize GLFW");
+    }
+    g_glfw_users++;
+
+    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
+    g_window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
+    if (!g_window) {
+        releaseGlfw();
+        throw std::runtime_error("Failed to create GLFW window");
+    }
+
+    glfwMakeContextCurrent(g_window);
+    g_api = Api::Glfw;
+}
+
+void GLContext::makeCurrent() {
+#ifdef PS_HAVE_EGL
+    if (g_egl_context) {
+        eglMakeCurrent(g_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, g_egl_context);
+        return;
+    }
+#endif
+    glfwMakeContextCurrent(g_window);
+}
+
+void GLContext::release() {
+#ifdef PS_HAVE_EGL
+    if (g_egl_context) {
+        eglMakeCurrent(g_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        return;
+    }
+#endif
+    glfwMakeContextCurrent(nullptr);
+}
+
+void GLContext::destroy() {
+#ifdef PS_HAVE_EGL
+    if (g_egl_context) {
+        if (eglGetCurrentContext() == g_egl_context)
+            eglMakeCurrent(g_egl_display, EGL_NO_SURFACE, EGL_NO_SURFACE, EGL_NO_CONTEXT);
+        eglDestroyContext(g_egl_display, g_egl_context);
+        g_egl_context = nullptr;
+        std::lock_guard<std::mutex> lock(g_egl_mutex);
+        g_egl_users--;
+        terminateUnusedDisplay();
+    }
+#endif
+    if (g_window) {
+        glfwDestroyWindow(g_window);
+        g_window = nullptr;
+        std::lock_guard<std::mutex> lock(g_glfw_mutex);
+        releaseGlfw();
+    }
+}
@@ -1,157 +1,824 @@
 #include "gpu_compute.h"
+#include "metrics.h"
 #include <fstream>
 #include <sstream>
 #include <stdexcept>
 #include <vector>
 #include <algorithm>
-
-std::string ComputeGPU::loadShaderSource(const char* filePath) {
-    std::ifstream file(filePath);
-    if (!file.is_open()) {
-        throw std::runtime_error(std::string("Failed to open shader file: ") + filePath);
+#include <atomic>
+#include <chrono>
+#include <climits>
+#include <cstring>
+
+namespace {
+
+const char* storageName(Storage storage) {
+    switch (storage) {
+    case Storage::F16: return "f16";
+    case Storage::BF16: return "bf16";
+    default: return "f32";
     }
-    std::stringstream buffer;
-    buffer << file.rdbuf();
-    return buffer.str();
 }
 
-GLuint ComputeGPU::createComputeShaderProgram(const char* shaderPath) {
-    std::string src = loadShaderSource(shaderPath);
-    const char* source = src.c_str();
+// 16-bit formats go two to a uint.
+size_t storageBytes(size_t count, Storage storage) {
+    return storage == Storage::F32 ? count * sizeof(float) : (count + 1) / 2 * sizeof(GLuint);
+}
 
-    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
-    glShaderSource(shader, 1, &source, nullptr);
-    glCompileShader(shader);
+}
 
-    GLint success;
-    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
-    if (!success) {
-        char log[512];
-        glGetShaderInfoLog(shader, 512, nullptr, log);
-        throw std::runtime_error(std::string("Compute shader compilation failed: ") + log);
+// One submitted dispatch. Owns its buffers (none for a bare
+// processDataGPU_NoTransfer fence) until finishJob releases them, which the
+// device does as soon as the fence signals.
+struct ComputeGPU::GpuJob : Completion::State {
+    ComputeGPU* owner = nullptr;  // cleared once finished
+    std::shared_ptr<GpuDevice> device;
+    std::unique_ptr<kernels::Kernel> kernel;
+    FloatSpan data;
+    BufferPool::Buffer buffers[3];  // data, partials, bins
+    size_t groups = 0;
+    GLsync fence = nullptr;  // kept until the job dies, so waiters never see it deleted
+    std::atomic<bool> finished{false};  // result / error are set
+
+    ~GpuJob() override {
+        if (fence) device->call([this] {
+            device->unwatchFence(fence);
+            glDeleteSync(fence);
+        });
     }
 
-    GLuint program = glCreateProgram();
-    glAttachShader(program, shader);
-    glLinkProgram(program);
-
-    glGetProgramiv(program, GL_LINK_STATUS, &success);
-    if (!success) {
-        char log[512];
-        glGetProgramInfoLog(program, 512, nullptr, log);
-        throw std::runtime_error(std::string("Shader program linking failed: ") + log);
+    // owner is only touched on the submission thread, which also orders
+    // finishing against the owner's own commands.
+    void watch() {
+        device->watchFence(fence, [this] {
+            if (owner) owner->finishJob(*this);
+        });
     }
 
-    glDeleteShader(shader);
-    return program;
-}
-
-void ComputeGPU::init(const char* shaderPath) {
-    if (!glfwInit()) {
-        throw std::runtime_error("Failed to initialize GLFW");
+    bool poll() override {
+        return finished.load(std::memory_order_acquire);
     }
 
-    glfwWindowHint(GLFW_VISIBLE, GLFW_FALSE);
-    g_window = glfwCreateWindow(1, 1, "", nullptr, nullptr);
-    if (!g_window) {
-        throw std::runtime_error("Failed to create GLFW window");
+    void wait() override {
+        if (finished.load(std::memory_order_acquire)) return;
+        {
+            metrics::Scope sync(metrics::Counter::GpuSyncNs, "gpu.sync");
+            device->waitFence(fence);
+        }
+        device->call([this] {
+            if (owner) owner->finishJob(*this);
+        });
     }
+};
 
-    glfwMakeContextCurrent(g_window);
-
-    if (glewInit() != GLEW_OK) {
-        throw std::runtime_error("Failed to initialize GLEW");
+std::string ComputeGPU::loadShaderSource(const char* filePath) {
+    std::ifstream file(filePath);
+    if (!file.is_open()) {
+        throw std::runtime_error(std::string("Failed to open shader file: ") + filePath);
     }
+    std::stringstream buffer;
+    buffer << file.rdbuf();
+    return buffer.str();
+}
 
-    g_program = createComputeShaderProgram(shaderPath);
-
-    glGenBuffers(1, &sbo);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo);
-    glBufferData(GL_SHADER_STORAGE_BUFFER, 0, nullptr, GL_DYNAMIC_COPY);
+void ComputeGPU::init(const char* shaderPath) {
+    using clock = std::chrono::steady_clock;
+    g_startup = GpuStartup();
+    std::string source = loadShaderSource(shaderPath);
+
+    bool created = false;
+    g_device = GpuDevice::acquire(&created);
+    g_startup.context = g_device->apiName();
+    g_startup.context_ms = created ? g_device->contextMs() : 0.0;
+
+    auto start = clock::now();
+    try {
+        g_device->call([&] {
+            g_programs = &g_device->acquirePrograms(g_cache_dir);
+            size_t loaded = g_programs->stats().loaded;
+            g_program = &g_programs->get(source);
+            g_startup.program_from_disk = g_programs->stats().loaded > loaded;
+        });
+    } catch (...) {
+        // Leave nothing behind so callers can fall back or retry.
+        if (g_programs) g_device->call([this] { g_device->releasePrograms(g_programs->directory()); });
+        g_programs = nullptr;
+        g_device.reset();
+        throw;
+    }
+    g_startup.program_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
 
-    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &max_group_size);
+    std::string path(shaderPath);
+    size_t slash = path.find_last_of("/\\");
+    g_shader_dir = (slash == std::string::npos) ? "." : path.substr(0, slash);
+    max_group_size = g_device->maxGroupsX();
 
     gpu_initialized = true;
 }
 
-void ComputeGPU::uploadData(const std::vector<float>& data) {
+void ComputeGPU::uploadData(ConstFloatSpan data) {
     if (!g_program) {
         throw std::runtime_error("GPU not initialized. Call init first.");
     }
+    requireUnmapped();
 
-    size_t data_size = data.size() * sizeof(float);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo);
-
-    if (data_size != g_buffer_size) {
-        glBufferData(GL_SHADER_STORAGE_BUFFER, data_size, data.data(), GL_DYNAMIC_COPY);
+    g_device->call([&] {
+        metrics::Scope timer(metrics::Counter::GpuUploadNs, "gpu.upload");
+        size_t data_size = data.size() * sizeof(float);
+        metrics::add(metrics::Counter::GpuUploadBytes, data_size);
+        fillBuffer(sbo, data);
         g_buffer_size = data_size;
+        g_data_on_gpu = true;
+    });
+}
+
+template <class T>
+void ComputeGPU::fillBuffer(BufferPool::Buffer& buffer, StridedSpan<const T> data) {
+    size_t bytes = data.size() * sizeof(T);
+    g_device->buffers().reserve(buffer, bytes);
+    if (!bytes) return;
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer.id);
+    if (data.contiguous()) {
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bytes, data.data());
     } else {
-        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, data_size, data.data());
+        T* ptr = (T*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bytes, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+        if (!ptr) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            throw std::runtime_error("Failed to map GPU buffer for writing.");
+        }
+        for (size_t i = 0; i < data.size(); i++) ptr[i] = data[i];
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
     }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+}
 
-    g_data_on_gpu = true;
+template <class T>
+void ComputeGPU::readBuffer(GLuint buffer, StridedSpan<T> data) {
+    size_t bytes = data.size() * sizeof(T);
+    if (!bytes) return;
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, buffer);
+    const T* ptr;
+    {
+        metrics::Scope map(metrics::Counter::GpuMapNs, "gpu.map");
+        ptr = (const T*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bytes, GL_MAP_READ_BIT);
+    }
+    if (!ptr) {
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        throw std::runtime_error("Failed to map GPU buffer for reading.");
+    }
+    {
+        metrics::Scope copy(metrics::Counter::GpuDownloadNs, "gpu.download");
+        if (data.contiguous()) {
+            std::memcpy(data.data(), ptr, bytes);
+        } else {
+            for (size_t i = 0; i < data.size(); i++) data[i] = ptr[i];
+        }
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+    }
+    metrics::add(metrics::Counter::GpuDownloadBytes, bytes);
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
 }
 
-void ComputeGPU::process(std::vector<float>& data) {
+void ComputeGPU::process(FloatSpan data) {
     if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
     uploadData(data);
     processDataGPU_NoTransfer(data.size(), false);
     downloadData(data);
 }
 
-void ComputeGPU::downloadData(std::vector<float>& data) {
+void ComputeGPU::downloadData(FloatSpan data) {
     if (!g_data_on_gpu) throw std::runtime_error("No data on GPU to download.");
+    requireUnmapped();
+    size_t bytes = data.size() * sizeof(float);
+    if (bytes > g_buffer_size) throw std::runtime_error("Download larger than GPU buffer.");
 
-    GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-    glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
-    glDeleteSync(sync);
+    waitForGpu();
 
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo);
-    float* ptr = (float*)glMapBuffer(GL_SHADER_STORAGE_BUFFER, GL_READ_ONLY);
-    if (!ptr) {
-        throw std::runtime_error("Failed to map GPU buffer for reading.");
+    g_device->call([&] {
+        g_data_on_gpu = false;
+        readBuffer(sbo.id, data);
+    });
+}
+
+ComputeGPU::MappedView ComputeGPU::mapResults(size_t count) {
+    if (!g_data_on_gpu) throw std::runtime_error("No data on GPU to map.");
+    requireUnmapped();
+    if (count * sizeof(float) > g_buffer_size) throw std::runtime_error("Mapping larger than GPU buffer.");
+
+    waitForGpu();
+
+    const float* ptr = nullptr;
+    if (count) {
+        ptr = g_device->call([&] {
+            metrics::Scope map(metrics::Counter::GpuMapNs, "gpu.map");
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo.id);
+            auto mapped =
+                (const float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, count * sizeof(float), GL_MAP_READ_BIT);
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            if (!mapped) throw std::runtime_error("Failed to map GPU buffer for reading.");
+            g_results_mapped = true;
+            return mapped;
+        });
     }
+    return MappedView(this, ptr, count);
+}
 
-    std::copy(ptr, ptr + data.size(), data.begin());
-    glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
-    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+void ComputeGPU::waitForGpu() {
+    metrics::Scope sync(metrics::Counter::GpuSyncNs, "gpu.sync");
+    // Fence, first wait slice and cleanup share one round trip when the GPU
+    // is already (nearly) done, as it usually is by the time results are read.
+    GLsync fence = g_device->call([] {
+        GLsync f = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        if (glClientWaitSync(f, GL_SYNC_FLUSH_COMMANDS_BIT, GpuDevice::kWaitSliceNs) == GL_TIMEOUT_EXPIRED) return f;
+        glDeleteSync(f);
+        return GLsync(nullptr);
+    });
+    if (!fence) return;
+    g_device->waitFence(fence);
+    g_device->call([fence] { glDeleteSync(fence); });
+}
 
-    g_data_on_gpu = false;
+void ComputeGPU::requireUnmapped() const {
+    if (g_results_mapped) throw std::runtime_error("GPU results are mapped; destroy the MappedView first.");
+}
+
+void ComputeGPU::releaseMappedView() {
+    g_device->call([this] {
+        if (!g_results_mapped) return;
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo.id);
+        glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+        g_results_mapped = false;
+    });
+}
+
+ComputeGPU::MappedView::MappedView(MappedView&& other) noexcept
+    : owner(other.owner), ptr(other.ptr), count(other.count) {
+    other.owner = nullptr;
+}
+
+ComputeGPU::MappedView::~MappedView() {
+    if (owner && ptr) owner->releaseMappedView();
 }
 
-void ComputeGPU::processDataGPU_NoTransfer(size_t data_count, bool wait_for_completion) {
+Completion ComputeGPU::processDataGPU_NoTransfer(size_t data_count, bool wait_for_completion) {
     if (!g_program) throw std::runtime_error("GPU not initialized.");
     if (!g_data_on_gpu) throw std::runtime_error("No data on GPU. Call uploadData first.");
+    requireUnmapped();
+
+    Completion done = g_device->call([&] {
+        metrics::Scope dispatch(metrics::Counter::GpuDispatchNs, "gpu.dispatch");
+        // Bind only the uploaded bytes: the shader bounds itself with
+        // data.length(), and the pooled buffer may be larger.
+        if (g_buffer_size) glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, sbo.id, 0, g_buffer_size);
+        glUseProgram(g_program->id);
+
+        GLuint groups_x, groups_y;
+        computeGroups(data_count, groups_x, groups_y);
+        glUniform1ui(g_program->groups_x, groups_x);
+
+        glDispatchCompute(groups_x, groups_y, 1);
+        glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+
+        pruneJobs();
+        auto job = std::make_shared<GpuJob>();
+        job->device = g_device;
+        job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();
+        job->owner = this;
+        job->watch();
+        g_jobs.push_back(job);
+        return Completion(std::move(job));
+    });
 
-    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, sbo);
-    glUseProgram(g_program);
+    if (wait_for_completion) {
+        done.wait();
+        return Completion();
+    }
+    return done;
+}
 
+void ComputeGPU::computeGroups(size_t data_count, GLuint& groups_x, GLuint& groups_y) const {
     size_t total_workgroups_1D = (data_count + 255) / 256;
+    if (total_workgroups_1D == 0) {
+        groups_x = groups_y = 0;
+        return;
+    }
     size_t max_limit = static_cast<size_t>(max_group_size);
-    GLuint groups_x = (GLuint)std::min(total_workgroups_1D, max_limit);
-    GLuint groups_y = (GLuint)((total_workgroups_1D + groups_x - 1) / groups_x);
+    groups_x = (GLuint)std::min(total_workgroups_1D, max_limit);
+    groups_y = (GLuint)((total_workgroups_1D + groups_x - 1) / groups_x);
+}
+
+std::string ComputeGPU::buildKernelSource(const kernels::Kernel& kernel, Storage storage, bool batched) {
+    using kernels::Reduce;
+    if (g_kernel_template.empty()) {
+        g_kernel_template = loadShaderSource((g_shader_dir + "/kernel_template.glsl").c_str());
+    }
 
-    GLint groups_x_loc = glGetUniformLocation(g_program, "u_GroupsX");
-    if (groups_x_loc != -1) glUniform1ui(groups_x_loc, groups_x);
+    std::ostringstream src;
+    src << "#version 430\n"
+        << "#define REDUCE_NONE " << static_cast<int>(Reduce::None) << "\n"
+        << "#define REDUCE_SUM " << static_cast<int>(Reduce::Sum) << "\n"
+        << "#define REDUCE_MIN " << static_cast<int>(Reduce::Min) << "\n"
+        << "#define REDUCE_MAX " << static_cast<int>(Reduce::Max) << "\n"
+        << "#define REDUCE_HISTOGRAM " << static_cast<int>(Reduce::Histogram) << "\n"
+        << "#define REDUCE_OP " << static_cast<int>(kernel.reduce()) << "\n"
+        << "#define WRITE_BACK " << (kernel.writeBack() ? 1 : 0) << "\n"
+        << "#define STORAGE_F32 " << static_cast<int>(Storage::F32) << "\n"
+        << "#define STORAGE_F16 " << static_cast<int>(Storage::F16) << "\n"
+        << "#define STORAGE_BF16 " << static_cast<int>(Storage::BF16) << "\n"
+        << "#define STORAGE " << static_cast<int>(storage) << "\n"
+        << "#define BATCHED " << (batched ? 1 : 0) << "\n"
+        << "void mapValue(inout float x) {\n" << kernel.glsl() << "\n}\n"
+        << "#line 1\n"
+        << g_kernel_template;
+    return src.str();
+}
+
+const ProgramCache::Program& ComputeGPU::kernelProgram(const kernels::Kernel& kernel, Storage storage,
+                                                       bool batched) {
+    std::string key = kernel.key() + "/" + storageName(storage) + (batched ? "/batch" : "");
+    return g_device->call([&]() -> const ProgramCache::Program& {
+        auto it = g_kernel_programs.find(key);
+        if (it != g_kernel_programs.end()) return *it->second;
+
+        const ProgramCache::Program& program = g_programs->get(buildKernelSource(kernel, storage, batched));
+        g_kernel_programs.emplace(key, &program);
+        return program;
+    });
+}
+
+size_t ComputeGPU::dispatchKernel(const ProgramCache::Program& program, const kernels::Kernel& kernel, size_t count,
+                                  GLuint data_buffer, BufferPool::Buffer& partials, BufferPool::Buffer& bins,
+                                  Storage storage, size_t arrays) {
+    using kernels::Reduce;
+    metrics::Scope dispatch(metrics::Counter::GpuDispatchNs, "gpu.dispatch");
+    // Packed formats run one invocation per pair of elements.
+    size_t invocations = storage == Storage::F32 ? count : (count + 1) / 2;
+    GLuint groups_x, groups_y;
+    computeGroups(invocations, groups_x, groups_y);
+    size_t groups = static_cast<size_t>(groups_x) * groups_y;
+
+    Reduce reduce = kernel.reduce();
+    bool group_partials = reduce == Reduce::Sum || reduce == Reduce::Min || reduce == Reduce::Max;
+    const kernels::HistogramSpec& hist = kernel.histogram();
+
+    BufferPool& pool = g_device->buffers();
+    if (group_partials) pool.reserve(partials, groups * sizeof(float));
+    if (reduce == Reduce::Histogram) {
+        std::vector<GLuint> zeros(arrays * hist.bins, 0);
+        pool.reserve(bins, zeros.size() * sizeof(GLuint));
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bins.id);
+        glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, zeros.size() * sizeof(GLuint), zeros.data());
+    }
+
+    glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, data_buffer, 0, static_cast<GLsizeiptr>(storageBytes(count, storage)));
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 1, partials.id);
+    glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 2, bins.id);
+    glUseProgram(program.id);
+
+    // Unused uniforms are optimized out; glUniform* ignores location -1.
+    glUniform1ui(program.groups_x, groups_x);
+    glUniform1ui(program.count, (GLuint)count);
+    glUniform1f(program.hist_lo, hist.lo);
+    glUniform1f(program.hist_scale, static_cast<float>(hist.bins) / (hist.hi - hist.lo));
+    glUniform1ui(program.hist_bins, hist.bins);
+    glUniform1ui(program.arrays, (GLuint)arrays);
 
     glDispatchCompute(groups_x, groups_y, 1);
-    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT);
+    glMemoryBarrier(GL_SHADER_STORAGE_BARRIER_BIT | GL_BUFFER_UPDATE_BARRIER_BIT);
+    return groups;
+}
 
-    if (wait_for_completion) {
-        GLsync sync = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
-        glClientWaitSync(sync, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
-        glDeleteSync(sync);
+std::vector<kernels::Partial> ComputeGPU::readPartials(const kernels::Kernel& kernel,
+                                                       const std::vector<size_t>& group_bounds,
+                                                       GLuint partials_buffer, GLuint bins_buffer) {
+    using kernels::Reduce;
+    Reduce reduce = kernel.reduce();
+    std::vector<kernels::Partial> totals(group_bounds.size() - 1);
+    if (reduce == Reduce::Sum || reduce == Reduce::Min || reduce == Reduce::Max) {
+        std::vector<float> partials(group_bounds.back());
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, partials_buffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, partials.size() * sizeof(float), partials.data());
+        for (size_t a = 0; a < totals.size(); a++) {
+            kernels::Partial& total = totals[a];
+            for (size_t g = group_bounds[a]; g < group_bounds[a + 1]; g++) {
+                float v = partials[g];
+                total.sum += v;
+                total.min = std::min(total.min, v);
+                total.max = std::max(total.max, v);
+            }
+        }
     }
+    if (reduce == Reduce::Histogram) {
+        size_t per_array = kernel.histogram().bins;
+        std::vector<GLuint> bins(totals.size() * per_array);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, bins_buffer);
+        glGetBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, bins.size() * sizeof(GLuint), bins.data());
+        for (size_t a = 0; a < totals.size(); a++)
+            totals[a].bins.assign(bins.begin() + a * per_array, bins.begin() + (a + 1) * per_array);
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    return totals;
+}
+
+kernels::Result ComputeGPU::run(const kernels::Kernel& kernel, FloatSpan data) {
+    if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
+
+    const ProgramCache::Program& program = kernelProgram(kernel);
+    size_t count = data.size();
+    if (count == 0) return kernel.finish(kernels::Partial());
+
+    uploadData(data);
+    size_t groups = g_device->call([&] { return dispatchKernel(program, kernel, count, sbo.id, partials_sbo, bins_sbo); });
+    // Wait off the submission thread; reading the partials back there would
+    // hold it for the whole dispatch.
+    waitForGpu();
+    kernels::Partial total =
+        g_device->call([&] { return readPartials(kernel, {0, groups}, partials_sbo.id, bins_sbo.id)[0]; });
+
+    if (kernel.writeBack()) downloadData(data);
+    return kernel.finish(total);
+}
+
+Completion ComputeGPU::submit(const kernels::Kernel& kernel, FloatSpan data) {
+    if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
+
+    return g_device->call([&] {
+        pruneJobs();
+        const ProgramCache::Program& program = kernelProgram(kernel);
+        size_t count = data.size();
+        if (count == 0) return Completion::completed(kernel.finish(kernels::Partial()));
+
+        auto job = std::make_shared<GpuJob>();
+        job->device = g_device;
+        job->kernel = std::make_unique<kernels::Kernel>(kernel);
+        job->data = data;
+
+        try {
+            metrics::Scope upload(metrics::Counter::GpuUploadNs, "gpu.upload");
+            metrics::add(metrics::Counter::GpuUploadBytes, count * sizeof(float));
+            fillBuffer(job->buffers[0], ConstFloatSpan(data));
+        } catch (...) {
+            g_device->buffers().release(job->buffers[0]);
+            throw;
+        }
+
+        job->groups = dispatchKernel(program, kernel, count, job->buffers[0].id, job->buffers[1], job->buffers[2]);
+        job->fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+        glFlush();  // so testing the fence with a zero timeout makes progress
+
+        job->owner = this;
+        job->watch();
+        g_jobs.push_back(job);
+        return Completion(std::move(job));
+    });
+}
+
+kernels::Result ComputeGPU::run(const kernels::Kernel& kernel, HalfSpan data) {
+    return runPacked(kernel, data, Storage::F16);
+}
+
+kernels::Result ComputeGPU::run(const kernels::Kernel& kernel, BFloat16Span data) {
+    return runPacked(kernel, data, Storage::BF16);
+}
+
+template <class T>
+kernels::Result ComputeGPU::runPacked(const kernels::Kernel& kernel, StridedSpan<T> data, Storage storage) {
+    if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
+    requireUnmapped();
+
+    const ProgramCache::Program& program = kernelProgram(kernel, storage);
+    size_t count = data.size();
+    if (count == 0) return kernel.finish(kernels::Partial());
+
+    size_t groups = g_device->call([&] {
+        {
+            metrics::Scope upload(metrics::Counter::GpuUploadNs, "gpu.upload");
+            metrics::add(metrics::Counter::GpuUploadBytes, count * sizeof(T));
+            fillBuffer<T>(sbo, data);
+        }
+        // sbo no longer holds floats for downloadData / mapResults.
+        g_buffer_size = 0;
+        g_data_on_gpu = false;
+        return dispatchKernel(program, kernel, count, sbo.id, partials_sbo, bins_sbo, storage);
+    });
+    waitForGpu();
+
+    return g_device->call([&] {
+        if (kernel.writeBack()) readBuffer(sbo.id, data);
+        return kernel.finish(readPartials(kernel, {0, groups}, partials_sbo.id, bins_sbo.id)[0]);
+    });
+}
+
+std::vector<kernels::Result> ComputeGPU::runBatch(const kernels::Kernel& kernel,
+                                                  const std::vector<FloatSpan>& arrays) {
+    if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
+    requireUnmapped();
+    if (arrays.empty()) return {};
+
+    // The offsets table kernel_template.glsl reads: array a at segments[2a],
+    // padded to whole workgroups so each workgroup's partial belongs to one
+    // array, then each workgroup's array.
+    constexpr size_t kGroupSize = 256;
+    std::vector<GLuint> segments(2 * arrays.size());
+    std::vector<size_t> group_bounds(arrays.size() + 1, 0);
+    size_t total = 0;
+    for (size_t a = 0; a < arrays.size(); a++) {
+        size_t padded = (arrays[a].size() + kGroupSize - 1) / kGroupSize * kGroupSize;
+        if (total + padded > UINT_MAX) throw std::runtime_error("Batch too large for one dispatch.");
+        segments[2 * a] = (GLuint)total;
+        segments[2 * a + 1] = (GLuint)arrays[a].size();
+        total += padded;
+        group_bounds[a + 1] = total / kGroupSize;
+        segments.insert(segments.end(), padded / kGroupSize, (GLuint)a);
+    }
+
+    std::vector<kernels::Result> results(arrays.size());
+    if (total == 0) {
+        for (kernels::Result& result : results) result = kernel.finish(kernels::Partial());
+        return results;
+    }
+
+    const ProgramCache::Program& program = kernelProgram(kernel, Storage::F32, true);
+    g_device->call([&] {
+        BufferPool& pool = g_device->buffers();
+        g_buffer_size = 0;
+        g_data_on_gpu = false;
+        {
+            metrics::Scope upload(metrics::Counter::GpuUploadNs, "gpu.upload");
+            pool.reserve(sbo, total * sizeof(float));
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo.id);
+            float* ptr = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, total * sizeof(float),
+                                                  GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT);
+            if (!ptr) {
+                glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+                throw std::runtime_error("Failed to map GPU buffer for writing.");
+            }
+            size_t bytes = 0;
+            for (size_t a = 0; a < arrays.size(); a++) {
+                if (arrays[a].empty()) continue;
+                gatherSpan(arrays[a], 0, arrays[a].size(), ptr + segments[2 * a]);
+                bytes += arrays[a].size() * sizeof(float);
+            }
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+
+            pool.reserve(segments_sbo, segments.size() * sizeof(GLuint));
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, segments_sbo.id);
+            glBufferSubData(GL_SHADER_STORAGE_BUFFER, 0, segments.size() * sizeof(GLuint), segments.data());
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            metrics::add(metrics::Counter::GpuUploadBytes, bytes + segments.size() * sizeof(GLuint));
+        }
+
+        glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 3, segments_sbo.id, 0,
+                          static_cast<GLsizeiptr>(segments.size() * sizeof(GLuint)));
+        dispatchKernel(program, kernel, total, sbo.id, partials_sbo, bins_sbo, Storage::F32, arrays.size());
+    });
+    waitForGpu();
+
+    g_device->call([&] {
+        std::vector<kernels::Partial> totals = readPartials(kernel, group_bounds, partials_sbo.id, bins_sbo.id);
+        for (size_t a = 0; a < arrays.size(); a++) results[a] = kernel.finish(totals[a]);
+        if (!kernel.writeBack()) return;
+
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, sbo.id);
+        const float* ptr;
+        {
+            metrics::Scope map(metrics::Counter::GpuMapNs, "gpu.map");
+            ptr = (const float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, total * sizeof(float), GL_MAP_READ_BIT);
+        }
+        if (!ptr) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            throw std::runtime_error("Failed to map GPU buffer for reading.");
+        }
+        size_t bytes = 0;
+        {
+            metrics::Scope copy(metrics::Counter::GpuDownloadNs, "gpu.download");
+            for (size_t a = 0; a < arrays.size(); a++) {
+                if (arrays[a].empty()) continue;
+                scatterSpan(ptr + segments[2 * a], arrays[a].size(), arrays[a], 0);
+                bytes += arrays[a].size() * sizeof(float);
+            }
+            glUnmapBuffer(GL_SHADER_STORAGE_BUFFER);
+        }
+        metrics::add(metrics::Counter::GpuDownloadBytes, bytes);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    });
+    return results;
+}
+
+void ComputeGPU::finishJob(GpuJob& job) {
+    try {
+        if (job.kernel) {
+            const kernels::Kernel& kernel = *job.kernel;
+            if (kernel.writeBack()) readBuffer(job.buffers[0].id, job.data);
+            job.result = kernel.finish(readPartials(kernel, {0, job.groups}, job.buffers[1].id, job.buffers[2].id)[0]);
+        }
+    } catch (...) {
+        job.error = std::current_exception();
+    }
+
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    for (BufferPool::Buffer& buffer : job.buffers) g_device->buffers().release(buffer);
+    job.owner = nullptr;
+    job.finished.store(true, std::memory_order_release);
+}
+
+void ComputeGPU::pruneJobs() {
+    // The device finishes jobs as their fences signal; drop those.
+    g_jobs.erase(std::remove_if(g_jobs.begin(), g_jobs.end(),
+                                [](const std::shared_ptr<GpuJob>& job) { return job->owner == nullptr; }),
+                 g_jobs.end());
+}
+
+StreamingStats ComputeGPU::processStreaming(FloatSpan data, const StreamingOptions& options) {
+    if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
+    return streamWithProgram(*g_program, data, options);
+}
+
+StreamingStats ComputeGPU::processStreaming(const kernels::Kernel& kernel, FloatSpan data,
+                                            const StreamingOptions& options) {
+    if (!gpu_initialized) throw std::runtime_error("GPU not initialized.");
+    if (kernel.reduce() != kernels::Reduce::None || !kernel.writeBack()) {
+        throw std::runtime_error("Streaming supports map kernels only.");
+    }
+    return streamWithProgram(kernelProgram(kernel), data, options);
+}
+
+void ComputeGPU::ensureStreamSlots(const StreamingOptions& options) {
+    if (options.slots < 2 || options.slots > 4) throw std::runtime_error("Streaming needs 2 to 4 slots.");
+    if (options.chunk_elements == 0) throw std::runtime_error("Streaming chunk size must be greater than zero.");
+    if (!GLEW_VERSION_4_4 && !GLEW_ARB_buffer_storage) {
+        throw std::runtime_error("Streaming requires GL 4.4 or ARB_buffer_storage.");
+    }
+
+    if (g_stream_slots.size() == options.slots && g_stream_chunk == options.chunk_elements) return;
+    releaseStreamSlots();
+
+    GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_READ_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    GLsizeiptr bytes = static_cast<GLsizeiptr>(options.chunk_elements * sizeof(float));
+
+    g_stream_slots.resize(options.slots);
+    for (StreamSlot& slot : g_stream_slots) {
+        glGenBuffers(1, &slot.buffer);
+        glBindBuffer(GL_SHADER_STORAGE_BUFFER, slot.buffer);
+        glBufferStorage(GL_SHADER_STORAGE_BUFFER, bytes, nullptr, flags);
+        slot.mapped = (float*)glMapBufferRange(GL_SHADER_STORAGE_BUFFER, 0, bytes, flags);
+        if (!slot.mapped) {
+            glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+            releaseStreamSlots();
+            throw std::runtime_error("Failed to map streaming buffer.");
+        }
+    }
+    glBindBuffer(GL_SHADER_STORAGE_BUFFER, 0);
+    g_stream_chunk = options.chunk_elements;
+}
+
+void ComputeGPU::releaseStreamSlots() {
+    for (StreamSlot& slot : g_stream_slots) {
+        if (slot.fence) glDeleteSync(slot.fence);
+        // Deleting a buffer also drops its persistent mapping.
+        if (slot.buffer) glDeleteBuffers(1, &slot.buffer);
+    }
+    g_stream_slots.clear();
+    g_stream_chunk = 0;
+}
+
+void ComputeGPU::retireStreamSlot(StreamSlot& slot, FloatSpan data, StreamingStats& stats) {
+    using clock = std::chrono::steady_clock;
+    if (!slot.fence) return;
+
+    auto t0 = clock::now();
+    {
+        metrics::Scope sync(metrics::Counter::GpuSyncNs, "gpu.sync");
+        g_device->waitFence(slot.fence);
+    }
+    g_device->call([&slot] { glDeleteSync(slot.fence); });
+    slot.fence = nullptr;
+    auto t1 = clock::now();
+
+    {
+        metrics::Scope copy(metrics::Counter::GpuDownloadNs, "gpu.download");
+        scatterSpan(slot.mapped, slot.count, data, slot.offset);
+    }
+    metrics::add(metrics::Counter::GpuDownloadBytes, slot.count * sizeof(float));
+    auto t2 = clock::now();
+
+    stats.wait_ms += std::chrono::duration<double, std::milli>(t1 - t0).count();
+    stats.download_ms += std::chrono::duration<double, std::milli>(t2 - t1).count();
+}
+
+StreamingStats ComputeGPU::streamWithProgram(const ProgramCache::Program& program, FloatSpan data,
+                                             const StreamingOptions& options) {
+    using clock = std::chrono::steady_clock;
+    g_device->call([&] {
+        ensureStreamSlots(options);
+
+        // Fences left by a call that threw half-way belong to another buffer.
+        for (StreamSlot& slot : g_stream_slots) {
+            if (!slot.fence) continue;
+            glClientWaitSync(slot.fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+            glDeleteSync(slot.fence);
+            slot.fence = nullptr;
+        }
+    });
+
+    StreamingStats stats;
+    auto start = clock::now();
+
+    size_t n = data.size();
+    size_t chunk = options.chunk_elements;
+    size_t chunks = (n + chunk - 1) / chunk;
+    size_t slots = g_stream_slots.size();
+
+    // Copies in and out of the persistently mapped slots run on this thread;
+    // only the dispatches go to the submission thread.
+    for (size_t c = 0; c < chunks; c++) {
+        StreamSlot& slot = g_stream_slots[c % slots];
+        // The slot still holds chunk c - slots; collect it before reuse.
+        retireStreamSlot(slot, data, stats);
+
+        slot.offset = c * chunk;
+        slot.count = std::min(chunk, n - slot.offset);
+
+        auto t0 = clock::now();
+        {
+            metrics::Scope upload(metrics::Counter::GpuUploadNs, "gpu.upload");
+            gatherSpan(data, slot.offset, slot.count, slot.mapped);
+        }
+        metrics::add(metrics::Counter::GpuUploadBytes, slot.count * sizeof(float));
+        stats.upload_ms += std::chrono::duration<double, std::milli>(clock::now() - t0).count();
+
+        GLuint groups_x, groups_y;
+        computeGroups(slot.count, groups_x, groups_y);
+
+        g_device->call([&] {
+            metrics::Scope dispatch(metrics::Counter::GpuDispatchNs, "gpu.dispatch");
+            // Bind just this chunk so data.length() in the shader matches count.
+            glBindBufferRange(GL_SHADER_STORAGE_BUFFER, 0, slot.buffer, 0,
+                              static_cast<GLsizeiptr>(slot.count * sizeof(float)));
+            glUseProgram(program.id);
+            glUniform1ui(program.groups_x, groups_x);
+            glUniform1ui(program.count, (GLuint)slot.count);
+            glDispatchCompute(groups_x, groups_y, 1);
+            glMemoryBarrier(GL_CLIENT_MAPPED_BUFFER_BARRIER_BIT);
+            slot.fence = glFenceSync(GL_SYNC_GPU_COMMANDS_COMPLETE, 0);
+            glFlush();
+        });
+
+        stats.chunks++;
+        stats.bytes += slot.count * sizeof(float);
+    }
+
+    // Drain in submission order.
+    size_t first = chunks > slots ? chunks - slots : 0;
+    for (size_t c = first; c < chunks; c++)
+        retireStreamSlot(g_stream_slots[c % slots], data, stats);
+
+    g_device->call([] { glBindBufferBase(GL_SHADER_STORAGE_BUFFER, 0, 0); });
+    stats.total_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    return stats;
 }
 
 void ComputeGPU::shutdown() {
     if (!gpu_initialized) return;
 
-    if (sbo) glDeleteBuffers(1, &sbo);
-    if (g_program) glDeleteProgram(g_program);
-    if (g_window) glfwDestroyWindow(g_window);
+    g_device->call([this] {
+        for (const auto& job : g_jobs) job->wait();
+        g_jobs.clear();
+        releaseMappedView();
+        releaseStreamSlots();
+        BufferPool& pool = g_device->buffers();
+        pool.release(sbo);
+        pool.release(partials_sbo);
+        pool.release(bins_sbo);
+        pool.release(segments_sbo);
+        // The device's cache for this directory goes with its last user.
+        g_device->releasePrograms(g_programs->directory());
+    });
+    g_kernel_programs.clear();
+    g_kernel_template.clear();
+    g_program = nullptr;
+    g_programs = nullptr;
+    g_device.reset();
 
     gpu_initialized = false;
-    glfwTerminate();
     g_buffer_size = 0;
+    g_data_on_gpu = false;
+}
+
+GpuDevice& ComputeGPU::device() const {
+    if (!g_device) throw std::runtime_error("GPU not initialized.");
+    return *g_device;
+}
+
+ProgramCache::Stats ComputeGPU::programCacheStats() const {
+    if (!g_device) return ProgramCache::Stats();
+    return g_device->call([this] { return g_programs->stats(); });
+}
+
+BufferPool::Stats ComputeGPU::bufferPoolStats() const {
+    if (!g_device) return BufferPool::Stats();
+    return g_device->call([this] { return g_device->buffers().stats(); });
 }
@@ -0,0 +1,139 @@
+#include "gpu_device.h"
+#include "metrics.h"
+#include <algorithm>
+#include <chrono>
+#include <map>
+
+std::shared_ptr<GpuDevice> GpuDevice::acquire(bool* created) {
+    static std::mutex mutex;
+    static std::weak_ptr<GpuDevice> current;
+
+    std::lock_guard<std::mutex> lock(mutex);
+    if (created) *created = false;
+    if (std::shared_ptr<GpuDevice> device = current.lock()) return device;
+
+    std::shared_ptr<GpuDevice> device(new GpuDevice());
+    device->start();
+    current = device;
+    if (created) *created = true;
+    return device;
+}
+
+GpuDevice::~GpuDevice() {
+    if (!g_thread.joinable()) return;
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_stopping = true;
+    }
+    g_wake.notify_one();
+    // Dropping the last reference from inside a command would leave the
+    // loop running on a destroyed object.
+    if (onSubmissionThread()) std::terminate();
+    g_thread.join();
+    // The loop released the context; GLFW wants it destroyed off the
+    // submission thread, like it was created.
+    g_context.reset();
+}
+
+void GpuDevice::start() {
+    auto start = std::chrono::steady_clock::now();
+    g_context = std::make_unique<GLContext>();
+    g_context_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    g_api = g_context->apiName();
+    glGetIntegeri_v(GL_MAX_COMPUTE_WORK_GROUP_COUNT, 0, &g_max_groups_x);
+    g_context->release();
+
+    std::promise<void> ready;
+    std::future<void> started = ready.get_future();
+    g_thread = std::thread([this, &ready] {
+        g_thread_id = std::this_thread::get_id();
+        g_context->makeCurrent();
+        ready.set_value();
+        loop();
+    });
+    started.wait();
+}
+
+ProgramCache& GpuDevice::acquirePrograms(const std::string& directory) {
+    SharedPrograms& shared = g_programs[directory];
+    if (!shared.cache) shared.cache = std::make_unique<ProgramCache>(directory);
+    shared.users++;
+    return *shared.cache;
+}
+
+void GpuDevice::releasePrograms(const std::string& directory) {
+    auto it = g_programs.find(directory);
+    if (it == g_programs.end() || --it->second.users > 0) return;
+    it->second.cache->clear();
+    g_programs.erase(it);
+}
+
+void GpuDevice::post(std::function<void()> command) {
+    {
+        std::lock_guard<std::mutex> lock(g_mutex);
+        g_queue.push_back(std::move(command));
+    }
+    g_wake.notify_one();
+}
+
+void GpuDevice::loop() {
+    metrics::setThreadName("gpu submit");
+    for (;;) {
+        std::function<void()> command;
+        {
+            std::unique_lock<std::mutex> lock(g_mutex);
+            auto woken = [this] { return g_stopping || !g_queue.empty(); };
+            if (g_watches.empty()) {
+                g_wake.wait(lock, woken);
+            } else {
+                g_wake.wait_for(lock, std::chrono::nanoseconds(kWaitSliceNs), woken);
+            }
+            if (!g_queue.empty()) {
+                command = std::move(g_queue.front());
+                g_queue.pop_front();
+            } else if (g_stopping) {
+                break;
+            }
+        }
+        if (command) command();  // call() wraps commands in a packaged_task: never throws
+        checkWatches();
+    }
+
+    for (auto& entry : g_programs) entry.second.cache->clear();
+    g_programs.clear();
+    g_buffers.clear();
+    g_context->release();
+}
+
+void GpuDevice::watchFence(GLsync fence, std::function<void()> on_signaled) {
+    g_watches.emplace_back(fence, std::move(on_signaled));
+}
+
+void GpuDevice::unwatchFence(GLsync fence) {
+    g_watches.erase(std::remove_if(g_watches.begin(), g_watches.end(),
+                                   [fence](const auto& watch) { return watch.first == fence; }),
+                    g_watches.end());
+}
+
+void GpuDevice::checkWatches() {
+    for (size_t i = 0; i < g_watches.size();) {
+        if (glClientWaitSync(g_watches[i].first, 0, 0) == GL_TIMEOUT_EXPIRED) {
+            i++;
+            continue;
+        }
+        std::function<void()> on_signaled = std::move(g_watches[i].second);
+        g_watches.erase(g_watches.begin() + i);
+        on_signaled();
+    }
+}
+
+void GpuDevice::waitFence(GLsync fence) {
+    if (onSubmissionThread()) {
+        glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, GL_TIMEOUT_IGNORED);
+        return;
+    }
+    for (;;) {
+        GLenum status = call([fence] { return glClientWaitSync(fence, GL_SYNC_FLUSH_COMMANDS_BIT, kWaitSliceNs); });
+        if (status != GL_TIMEOUT_EXPIRED) return;
+    }
+}
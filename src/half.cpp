@@ -0,0 +1,150 @@
+#include "half.h"
+#include "simd_transform.h"
+#include "simd_transform_impl.h"
+#include <cstring>
+
+namespace {
+
+uint32_t floatBits(float x) {
+    uint32_t bits;
+    std::memcpy(&bits, &x, sizeof(bits));
+    return bits;
+}
+
+float bitsFloat(uint32_t bits) {
+    float x;
+    std::memcpy(&x, &bits, sizeof(x));
+    return x;
+}
+
+const uint16_t* raw(const Half* p) { return reinterpret_cast<const uint16_t*>(p); }
+const uint16_t* raw(const BFloat16* p) { return reinterpret_cast<const uint16_t*>(p); }
+uint16_t* raw(Half* p) { return reinterpret_cast<uint16_t*>(p); }
+uint16_t* raw(BFloat16* p) { return reinterpret_cast<uint16_t*>(p); }
+
+template <class T>
+void gatherConverted(StridedSpan<const T> span, size_t offset, size_t count, float* dst) {
+    if (span.contiguous()) {
+        toFloat(span.data() + offset, count, dst);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) dst[i] = toFloat(span[offset + i]);
+}
+
+template <class T, class Round>
+void scatterConverted(const float* src, size_t count, StridedSpan<T> span, size_t offset, Round round) {
+    if (span.contiguous()) {
+        fromFloat(src, count, span.data() + offset);
+        return;
+    }
+    for (size_t i = 0; i < count; i++) span[offset + i] = round(src[i]);
+}
+
+}
+
+float toFloat(Half h) {
+    // Rebias the exponent; subnormals are renormalized by a float subtract.
+    uint32_t bits = static_cast<uint32_t>(h.bits & 0x7fff) << 13;
+    uint32_t exponent = bits & 0x0f800000u;
+    bits += (127 - 15) << 23;
+    if (exponent == 0x0f800000u) {
+        bits += (128 - 16) << 23;  // Inf / NaN
+    } else if (exponent == 0) {
+        bits = floatBits(bitsFloat(bits + (1 << 23)) - bitsFloat(113u << 23));
+    }
+    return bitsFloat(bits | static_cast<uint32_t>(h.bits & 0x8000) << 16);
+}
+
+float toFloat(BFloat16 b) {
+    return bitsFloat(static_cast<uint32_t>(b.bits) << 16);
+}
+
+Half toHalf(float x) {
+    uint32_t bits = floatBits(x);
+    uint16_t sign = static_cast<uint16_t>((bits >> 16) & 0x8000);
+    uint32_t magnitude = bits & 0x7fffffffu;
+
+    uint32_t result;
+    if (magnitude > 0x7f800000u) {
+        result = 0x7e00 | ((magnitude >> 13) & 0x3ff);  // quiet NaN, as F16C does
+    } else if (magnitude >= 0x47800000u) {
+        result = 0x7c00;  // 2^16 and up, Inf
+    } else if (magnitude < 0x38800000u) {
+        // Half subnormals and zero: adding 0.5 lines the bits up with the
+        // half's 2^-24 steps, and the FPU rounds to nearest even.
+        result = floatBits(bitsFloat(magnitude) + 0.5f) - floatBits(0.5f);
+    } else {
+        // Round to nearest even on the dropped 13 bits; a carry into the
+        // exponent gives the next binade, or Inf past 65504.
+        uint32_t odd = (magnitude >> 13) & 1;
+        result = (magnitude + (static_cast<uint32_t>(15 - 127) << 23) + 0xfff + odd) >> 13;
+    }
+    return Half{static_cast<uint16_t>(result | sign)};
+}
+
+BFloat16 toBFloat16(float x) {
+    uint32_t bits = floatBits(x);
+    if ((bits & 0x7fffffffu) > 0x7f800000u) return BFloat16{static_cast<uint16_t>((bits >> 16) | 0x40)};
+    bits += 0x7fff + ((bits >> 16) & 1);
+    return BFloat16{static_cast<uint16_t>(bits >> 16)};
+}
+
+void toFloat(const Half* src, size_t count, float* dst) {
+    switch (simd::activeLevel()) {
+#if defined(PS_SIMD_X86)
+    case simd::Level::AVX512: simd::halfToFloatAVX512(raw(src), count, dst); return;
+    case simd::Level::AVX2: simd::halfToFloatAVX2(raw(src), count, dst); return;
+#endif
+    default:
+        for (size_t i = 0; i < count; i++) dst[i] = toFloat(src[i]);
+    }
+}
+
+void toFloat(const BFloat16* src, size_t count, float* dst) {
+    switch (simd::activeLevel()) {
+#if defined(PS_SIMD_X86)
+    case simd::Level::AVX512: simd::bf16ToFloatAVX512(raw(src), count, dst); return;
+    case simd::Level::AVX2: simd::bf16ToFloatAVX2(raw(src), count, dst); return;
+#endif
+    default:
+        for (size_t i = 0; i < count; i++) dst[i] = toFloat(src[i]);
+    }
+}
+
+void fromFloat(const float* src, size_t count, Half* dst) {
+    switch (simd::activeLevel()) {
+#if defined(PS_SIMD_X86)
+    case simd::Level::AVX512: simd::floatToHalfAVX512(src, count, raw(dst)); return;
+    case simd::Level::AVX2: simd::floatToHalfAVX2(src, count, raw(dst)); return;
+#endif
+    default:
+        for (size_t i = 0; i < count; i++) dst[i] = toHalf(src[i]);
+    }
+}
+
+void fromFloat(const float* src, size_t count, BFloat16* dst) {
+    switch (simd::activeLevel()) {
+#if defined(PS_SIMD_X86)
+    case simd::Level::AVX512: simd::floatToBf16AVX512(src, count, raw(dst)); return;
+    case simd::Level::AVX2: simd::floatToBf16AVX2(src, count, raw(dst)); return;
+#endif
+    default:
+        for (size_t i = 0; i < count; i++) dst[i] = toBFloat16(src[i]);
+    }
+}
+
+void gatherSpan(ConstHalfSpan span, size_t offset, size_t count, float* dst) {
+    gatherConverted(span, offset, count, dst);
+}
+
+void gatherSpan(ConstBFloat16Span span, size_t offset, size_t count, float* dst) {
+    gatherConverted(span, offset, count, dst);
+}
+
+void scatterSpan(const float* src, size_t count, HalfSpan span, size_t offset) {
+    scatterConverted(src, count, span, offset, toHalf);
+}
+
+void scatterSpan(const float* src, size_t count, BFloat16Span span, size_t offset) {
+    scatterConverted(src, count, span, offset, toBFloat16);
+}
@@ -0,0 +1,68 @@
+#include "huge_page_allocator.h"
+#include <cstdint>
+
+#ifdef __linux__
+#include <sys/mman.h>
+#endif
+
+namespace {
+
+constexpr size_t kHugePage = 2 << 20;
+constexpr size_t kCacheLine = 64;
+
+size_t roundUp(size_t bytes, size_t align) {
+    return (bytes + align - 1) / align * align;
+}
+
+}
+
+#ifdef __linux__
+
+void* allocateHugePages(size_t bytes) {
+    if (bytes < kHugePage) return ::operator new(bytes ? bytes : 1, std::align_val_t(kCacheLine));
+
+    // mmap only guarantees page alignment: over-allocate by one huge page
+    // and unmap the unaligned head and the tail.
+    size_t size = roundUp(bytes, kHugePage);
+    size_t span = size + kHugePage;
+    void* raw = ::mmap(nullptr, span, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (raw == MAP_FAILED) throw std::bad_alloc();
+
+    uintptr_t start = reinterpret_cast<uintptr_t>(raw);
+    uintptr_t aligned = roundUp(start, kHugePage);
+    if (aligned > start) ::munmap(raw, aligned - start);
+    size_t tail = (start + span) - (aligned + size);
+    if (tail) ::munmap(reinterpret_cast<void*>(aligned + size), tail);
+
+    void* p = reinterpret_cast<void*>(aligned);
+#ifdef MADV_HUGEPAGE
+    ::madvise(p, size, MADV_HUGEPAGE);  // best effort: THP may be disabled
+#endif
+    return p;
+}
+
+void freeHugePages(void* ptr, size_t bytes) {
+    if (!ptr) return;
+    if (bytes < kHugePage) {
+        ::operator delete(ptr, std::align_val_t(kCacheLine));
+        return;
+    }
+    ::munmap(ptr, roundUp(bytes, kHugePage));
+}
+
+#else
+
+// Large pages elsewhere need privileges (SeLockMemoryPrivilege on Windows);
+// fall back to aligned heap memory.
+void* allocateHugePages(size_t bytes) {
+    size_t align = bytes < kHugePage ? kCacheLine : kHugePage;
+    return ::operator new(bytes ? bytes : 1, std::align_val_t(align));
+}
+
+void freeHugePages(void* ptr, size_t bytes) {
+    if (!ptr) return;
+    size_t align = bytes < kHugePage ? kCacheLine : kHugePage;
+    ::operator delete(ptr, std::align_val_t(align));
+}
+
+#endif
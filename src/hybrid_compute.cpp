@@ -0,0 +1,96 @@
+#include "hybrid_compute.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <stdexcept>
+
+namespace {
+// Never starve either side completely, otherwise its rate is never re-measured.
+constexpr double kMinFraction = 0.02;
+constexpr double kMaxFraction = 0.98;
+// GPU share is rounded down to whole workgroups' worth of elements.
+constexpr size_t kSplitAlign = 1024;
+}
+
+ComputeHybrid::ComputeHybrid(const char* shaderPath, const HybridOptions& options,
+                             std::shared_ptr<ThreadPool> pool)
+    : options(options), pool(pool ? std::move(pool) : ThreadPool::shared()),
+      gpu_fraction(std::min(std::max(options.initial_gpu_fraction, kMinFraction), kMaxFraction)) {
+    if (options.grain_size == 0) throw std::runtime_error("Grain size must be greater than zero.");
+
+    gpu = std::make_unique<ComputeGPU>(shaderPath);
+    try {
+        gpu->init(shaderPath);
+    } catch (const std::runtime_error&) {
+        gpu.reset();
+    }
+}
+
+void ComputeHybrid::process(FloatSpan data) {
+    run(kernels::makeMap<kernels::Transform>(), data);
+}
+
+kernels::Result ComputeHybrid::run(const kernels::Kernel& kernel, FloatSpan data) {
+    using clock = std::chrono::steady_clock;
+    size_t count = data.size();
+
+    size_t gpu_count = 0;
+    if (gpu && count >= options.min_gpu_elements) {
+        gpu_count = static_cast<size_t>(count * gpu_fraction) / kSplitAlign * kSplitAlign;
+    }
+    size_t cpu_count = count - gpu_count;
+
+    // CPU share goes to the pool first so it runs while this thread feeds the GPU.
+    kernels::Partial cpu_total;
+    std::mutex total_mutex;
+    std::atomic<int64_t> cpu_done_ns{0};
+    auto start = clock::now();
+
+    ThreadPool::Batch cpu_batch = pool->submit(0, cpu_count, options.grain_size, [&](size_t begin, size_t end) {
+        kernels::Partial partial;
+        ComputeCPU::runRange(kernel, data, begin, end, partial);
+        if (kernel.reduce() != kernels::Reduce::None) {
+            std::lock_guard<std::mutex> lk(total_mutex);
+            cpu_total.merge(partial);
+        }
+        int64_t now = std::chrono::duration_cast<std::chrono::nanoseconds>(clock::now() - start).count();
+        int64_t prev = cpu_done_ns.load();
+        while (now > prev && !cpu_done_ns.compare_exchange_weak(prev, now)) {}
+    });
+
+    kernels::Result gpu_result;
+    double gpu_ms = 0.0;
+    if (gpu_count) {
+        FloatSpan gpu_data = data.subspan(cpu_count, gpu_count);
+        if (kernel.reduce() == kernels::Reduce::None) {
+            gpu->processStreaming(kernel, gpu_data, options.streaming);
+        } else {
+            gpu_result = gpu->run(kernel, gpu_data);
+        }
+        gpu_ms = std::chrono::duration<double, std::milli>(clock::now() - start).count();
+    }
+
+    cpu_batch.wait();
+    double cpu_ms = cpu_done_ns.load() / 1e6;
+
+    updateSplit(cpu_count, cpu_ms, gpu_count, gpu_ms);
+
+    kernels::Result cpu_result = kernel.finish(cpu_total);
+    return gpu_count ? kernel.merge(cpu_result, gpu_result) : cpu_result;
+}
+
+void ComputeHybrid::updateSplit(size_t cpu_count, double cpu_ms, size_t gpu_count, double gpu_ms) {
+    // Only calls that used both sides say anything about the balance.
+    if (cpu_count == 0 || gpu_count == 0 || cpu_ms <= 0.0 || gpu_ms <= 0.0) return;
+
+    double alpha = options.smoothing;
+    double cpu_sample = cpu_count / cpu_ms;
+    double gpu_sample = gpu_count / gpu_ms;
+    cpu_rate = cpu_rate > 0.0 ? alpha * cpu_sample + (1.0 - alpha) * cpu_rate : cpu_sample;
+    gpu_rate = gpu_rate > 0.0 ? alpha * gpu_sample + (1.0 - alpha) * gpu_rate : gpu_sample;
+
+    // Both sides finish together when each gets work in proportion to its rate.
+    double fraction = gpu_rate / (cpu_rate + gpu_rate);
+    gpu_fraction = std::min(std::max(fraction, kMinFraction), kMaxFraction);
+}
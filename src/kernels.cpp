@@ -0,0 +1,59 @@
+#include "kernels.h"
+#include <stdexcept>
+
+namespace kernels {
+
+void Partial::merge(const Partial& other) {
+    sum += other.sum;
+    min = std::min(min, other.min);
+    max = std::max(max, other.max);
+    if (bins.size() < other.bins.size()) bins.resize(other.bins.size(), 0);
+    for (size_t i = 0; i < other.bins.size(); i++) bins[i] += other.bins[i];
+}
+
+Kernel::Kernel(std::string name, std::string glsl, CpuRangeFn cpu, Reduce reduce, bool write_back,
+               HistogramSpec histogram)
+    : kernel_name(std::move(name)), glsl_map(std::move(glsl)), cpu_fn(cpu),
+      reduce_op(reduce), write_back(write_back), hist(histogram) {
+    if (reduce_op == Reduce::Histogram && (hist.bins == 0 || !(hist.hi > hist.lo))) {
+        throw std::runtime_error("Histogram kernel needs bins > 0 and hi > lo.");
+    }
+}
+
+std::string Kernel::key() const {
+    static const char* reduce_names[] = {"none", "sum", "min", "max", "histogram"};
+    return kernel_name + "/" + reduce_names[static_cast<int>(reduce_op)] + (write_back ? "/wb" : "/ro");
+}
+
+Result Kernel::finish(const Partial& total) const {
+    Result result;
+    switch (reduce_op) {
+    case Reduce::Sum: result.value = total.sum; break;
+    case Reduce::Min: result.value = total.min; break;
+    case Reduce::Max: result.value = total.max; break;
+    case Reduce::Histogram:
+        result.histogram = total.bins;
+        result.histogram.resize(hist.bins, 0);
+        break;
+    default: break;
+    }
+    return result;
+}
+
+Result Kernel::merge(const Result& a, const Result& b) const {
+    Result result;
+    switch (reduce_op) {
+    case Reduce::Sum: result.value = a.value + b.value; break;
+    case Reduce::Min: result.value = std::min(a.value, b.value); break;
+    case Reduce::Max: result.value = std::max(a.value, b.value); break;
+    case Reduce::Histogram:
+        result.histogram.assign(hist.bins, 0);
+        for (size_t i = 0; i < a.histogram.size() && i < hist.bins; i++) result.histogram[i] += a.histogram[i];
+        for (size_t i = 0; i < b.histogram.size() && i < hist.bins; i++) result.histogram[i] += b.histogram[i];
+        break;
+    default: break;
+    }
+    return result;
+}
+
+}
@@ -1,56 +1,78 @@
 #include <iostream>
-#include <vector>
-#include <chrono>
-#include <thread>
 #include "cpu_compute.h"
 #include "gpu_compute.h"
+#include "hybrid_compute.h"
+#include "file_processor.h"
+#include "mapped_file.h"
 #include "ICompute.h"
+#include <cstring>
+#include <string>
 
-int main() {
-    int BenchmarkIterations = 2;
+static void usage() {
+    std::cout << "Usage: PS --input FILE [--output FILE] [--backend cpu|gpu|hybrid]\n"
+                 "          [--window-mb N] [--cold]\n"
+                 "  Transforms a raw float32 file, in place unless --output is given.\n"
+                 "  --cold evicts the file from the page cache before each pass.\n"
+                 "Benchmarks live in PS_bench.\n";
+}
 
-    const size_t N = 1ULL << 29;
-    std::vector<float> dataCPU(N, 64.0f);
-    std::vector<float> dataGPU = dataCPU;
-
-    std::unique_ptr<ComputeGPU> computeGPU = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
-    std::unique_ptr<ComputeCPU> computeCPU = std::make_unique<ComputeCPU>();
-
-    computeGPU = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
-    computeGPU->init("shaders/compute_shader.glsl");
-    computeGPU->uploadData(dataGPU);
-
-    computeCPU = std::make_unique<ComputeCPU>();
-
-    for (int i = 0; i < BenchmarkIterations; i++) {
-        std::cout << "\nRun #" << (i+1) << std::endl;
+static int processFileCommand(int argc, char** argv) {
+    std::string input, output, backend = "cpu";
+    FileOptions options;
+    bool cold = false;
+    for (int i = 1; i < argc; i++) {
+        std::string arg = argv[i];
+        bool has_value = i + 1 < argc;
+        if (arg == "--input" && has_value) input = argv[++i];
+        else if (arg == "--output" && has_value) output = argv[++i];
+        else if (arg == "--backend" && has_value) backend = argv[++i];
+        else if (arg == "--window-mb" && has_value) options.window_bytes = std::stoull(argv[++i]) << 20;
+        else if (arg == "--cold") cold = true;
+        else {
+            usage();
+            return 1;
+        }
+    }
+    if (input.empty()) {
+        usage();
+        return 1;
+    }
 
-        auto startCPU = std::chrono::high_resolution_clock::now();
-        computeCPU->process(dataCPU);
-        auto endCPU = std::chrono::high_resolution_clock::now();
-        std::chrono::duration<double, std::milli> cpuTime = endCPU - startCPU;
+    std::unique_ptr<ICompute> compute;
+    std::unique_ptr<ComputeGPU> gpu;
+    if (backend == "cpu") {
+        compute = std::make_unique<ComputeCPU>();
+    } else if (backend == "gpu") {
+        gpu = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
+        gpu->init("shaders/compute_shader.glsl");
+    } else if (backend == "hybrid") {
+        compute = std::make_unique<ComputeHybrid>("shaders/compute_shader.glsl");
+    } else {
+        usage();
+        return 1;
+    }
+    ICompute& engine = gpu ? static_cast<ICompute&>(*gpu) : *compute;
 
-        auto startGPU = std::chrono::high_resolution_clock::now();
-        computeGPU->processDataGPU_NoTransfer(dataGPU.size(), true);
-       
-        // computeGPU->process(dataGPU.size()); // uploads, processes, downloads data
-        auto endGPU = std::chrono::high_resolution_clock::now();
+    double disk = measureReadBandwidthGBs(input, cold);
+    if (cold) dropFileCache(input);
+    FileStats stats = processFile(engine, input, output, options);
 
-        std::chrono::duration<double, std::milli> gpuTime = endGPU - startGPU;
+    std::cout << "Processed " << stats.bytes / 1e9 << " GB in " << stats.windows << " windows, "
+              << stats.total_ms << " ms (" << backend << ")\n";
+    std::cout << "Throughput: " << stats.throughputGBs() << " GB/s, raw read: " << disk << " GB/s ("
+              << (disk > 0.0 ? 100.0 * stats.throughputGBs() / disk : 0.0) << "%)\n";
+    return 0;
+}
 
-        std::cout << "CPU time: " << cpuTime.count() << " ms\n";
-        std::cout << "GPU time: " << gpuTime.count() << " ms\n";
+int main(int argc, char** argv) {
+    if (argc < 2 || std::strcmp(argv[1], "--help") == 0 || std::strcmp(argv[1], "-h") == 0) {
+        usage();
+        return argc < 2 ? 1 : 0;
     }
-
-    auto startGPU = std::chrono::high_resolution_clock::now();
-    computeGPU->downloadData(dataGPU);
-    auto endGPU = std::chrono::high_resolution_clock::now();
-    std::chrono::duration<double, std::milli> gpuTime = endGPU - startGPU;
-    std::cout << "\nFinal GPU download time: " << gpuTime.count() << " ms\n";
-
-    for (size_t i = 0; i < 5; ++i) {
-        std::cout << "dataGPU[" << i << "] = " << dataGPU[i] << std::endl;
-        std::cout << "dataCPU[" << i << "] = " << dataCPU[i] << std::endl;
+    try {
+        return processFileCommand(argc, argv);
+    } catch (const std::exception& e) {
+        std::cerr << "Error: " << e.what() << std::endl;
+        return 1;
     }
-    return 0;
-}
\ No newline at end of file
+}
@@ -0,0 +1,201 @@
+#include "mapped_file.h"
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <stdexcept>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#else
+#include <cerrno>
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace {
+
+#ifdef _WIN32
+std::runtime_error fileError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + " (error " + std::to_string(GetLastError()) + ")");
+}
+#else
+std::runtime_error fileError(const std::string& what, const std::string& path) {
+    return std::runtime_error(what + " " + path + ": " + std::strerror(errno));
+}
+#endif
+
+}
+
+size_t MappedFile::pageSize() {
+#ifdef _WIN32
+    SYSTEM_INFO info;
+    GetSystemInfo(&info);
+    return info.dwAllocationGranularity;
+#else
+    static const size_t page = static_cast<size_t>(sysconf(_SC_PAGESIZE));
+    return page;
+#endif
+}
+
+#ifdef _WIN32
+
+MappedFile::MappedFile(const std::string& path, Mode mode, size_t size) : path(path), mode(mode) {
+    DWORD access = mode == Mode::Read ? GENERIC_READ : GENERIC_READ | GENERIC_WRITE;
+    DWORD disposition = mode == Mode::Create ? CREATE_ALWAYS : OPEN_EXISTING;
+    HANDLE h = CreateFileA(path.c_str(), access, FILE_SHARE_READ, nullptr, disposition,
+                           FILE_ATTRIBUTE_NORMAL | FILE_FLAG_SEQUENTIAL_SCAN, nullptr);
+    if (h == INVALID_HANDLE_VALUE) throw fileError("Failed to open", path);
+    file = h;
+
+    LARGE_INTEGER file_size;
+    if (mode == Mode::Create) {
+        file_size.QuadPart = static_cast<LONGLONG>(size);
+        if (!SetFilePointerEx(h, file_size, nullptr, FILE_BEGIN) || !SetEndOfFile(h)) {
+            close();
+            throw fileError("Failed to resize", path);
+        }
+    } else if (!GetFileSizeEx(h, &file_size)) {
+        close();
+        throw fileError("Failed to stat", path);
+    }
+    length = static_cast<size_t>(file_size.QuadPart);
+    if (length == 0) return;
+
+    mapping = CreateFileMappingA(h, nullptr, writable() ? PAGE_READWRITE : PAGE_READONLY, 0, 0, nullptr);
+    if (!mapping) {
+        close();
+        throw fileError("Failed to map", path);
+    }
+    base = static_cast<char*>(MapViewOfFile(mapping, writable() ? FILE_MAP_WRITE : FILE_MAP_READ, 0, 0, 0));
+    if (!base) {
+        close();
+        throw fileError("Failed to map", path);
+    }
+}
+
+void MappedFile::close() {
+    if (base) UnmapViewOfFile(base);
+    if (mapping) CloseHandle(mapping);
+    if (file) CloseHandle(file);
+    base = nullptr;
+    mapping = file = nullptr;
+}
+
+void MappedFile::advise(Advice advice, size_t offset, size_t bytes) {
+    if (!base || offset >= length) return;
+    size_t page = pageSize();
+    size_t start = offset / page * page;
+    size_t end = bytes ? std::min(length, offset + bytes) : length;
+    // The sequential hint was given to CreateFile; WillNeed is left to the
+    // cache manager's readahead.
+    if (advice == Advice::DontNeed) VirtualUnlock(base + start, end - start);
+}
+
+void MappedFile::flushAsync(size_t offset, size_t bytes) {
+    if (!base || !writable() || offset >= length) return;
+    FlushViewOfFile(base + offset, std::min(bytes, length - offset));
+}
+
+#else
+
+MappedFile::MappedFile(const std::string& path, Mode mode, size_t size) : path(path), mode(mode) {
+    int flags = mode == Mode::Read ? O_RDONLY : O_RDWR;
+    if (mode == Mode::Create) flags |= O_CREAT | O_TRUNC;
+    fd = ::open(path.c_str(), flags, 0644);
+    if (fd < 0) throw fileError("Failed to open", path);
+
+    if (mode == Mode::Create) {
+        if (::ftruncate(fd, static_cast<off_t>(size)) != 0) {
+            close();
+            throw fileError("Failed to resize", path);
+        }
+        length = size;
+    } else {
+        struct stat st;
+        if (::fstat(fd, &st) != 0) {
+            close();
+            throw fileError("Failed to stat", path);
+        }
+        length = static_cast<size_t>(st.st_size);
+    }
+    if (length == 0) return;
+
+    int prot = writable() ? PROT_READ | PROT_WRITE : PROT_READ;
+    void* p = ::mmap(nullptr, length, prot, MAP_SHARED, fd, 0);
+    if (p == MAP_FAILED) {
+        close();
+        throw fileError("Failed to map", path);
+    }
+    base = static_cast<char*>(p);
+}
+
+void MappedFile::close() {
+    if (base) ::munmap(base, length);
+    if (fd >= 0) ::close(fd);
+    base = nullptr;
+    fd = -1;
+}
+
+void MappedFile::advise(Advice advice, size_t offset, size_t bytes) {
+    if (!base || offset >= length) return;
+    size_t page = pageSize();
+    size_t start = offset / page * page;
+    size_t end = bytes ? std::min(length, offset + bytes) : length;
+
+    int hint = MADV_NORMAL;
+    switch (advice) {
+    case Advice::Sequential: hint = MADV_SEQUENTIAL; break;
+    case Advice::WillNeed: hint = MADV_WILLNEED; break;
+    // Shared file mapping: dirty pages stay in the page cache and are
+    // written back as usual, they just stop counting against our RSS.
+    case Advice::DontNeed: hint = MADV_DONTNEED; break;
+    }
+    ::madvise(base + start, end - start, hint);
+}
+
+void MappedFile::flushAsync(size_t offset, size_t bytes) {
+    if (!base || !writable() || offset >= length) return;
+    size_t page = pageSize();
+    size_t start = offset / page * page;
+    size_t end = std::min(length, offset + bytes);
+    ::msync(base + start, end - start, MS_ASYNC);
+}
+
+#endif
+
+MappedFile::~MappedFile() {
+    close();
+}
+
+void dropFileCache(const std::string& path) {
+#if defined(POSIX_FADV_DONTNEED)
+    int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) return;
+    ::fdatasync(fd);
+    ::posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    ::close(fd);
+#else
+    (void)path;
+#endif
+}
+
+double measureReadBandwidthGBs(const std::string& path, bool drop_cache) {
+    if (drop_cache) dropFileCache(path);
+
+    std::unique_ptr<std::FILE, int (*)(std::FILE*)> f(std::fopen(path.c_str(), "rb"), std::fclose);
+    if (!f) throw std::runtime_error("Failed to open " + path);
+    std::setvbuf(f.get(), nullptr, _IONBF, 0);
+
+    constexpr size_t kBuffer = 8 << 20;
+    std::unique_ptr<char[]> buffer(new char[kBuffer]);
+    size_t total = 0;
+    auto start = std::chrono::steady_clock::now();
+    for (size_t got; (got = std::fread(buffer.get(), 1, kBuffer, f.get())) > 0;) total += got;
+    double ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start).count();
+    return ms > 0.0 ? total / (ms * 1e6) : 0.0;
+}
@@ -0,0 +1,210 @@
+#include "metrics.h"
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <deque>
+#include <fstream>
+#include <iomanip>
+#include <memory>
+#include <mutex>
+#include <sstream>
+
+namespace metrics {
+
+namespace {
+
+const char* const kCounterNames[kCounters] = {
+    "cpu_busy_ns",     "cpu_idle_ns",      "cpu_chunks",          "cpu_elements",
+    "gpu_upload_ns",   "gpu_dispatch_ns",  "gpu_sync_ns",         "gpu_map_ns",
+    "gpu_download_ns", "gpu_upload_bytes", "gpu_download_bytes",  "gpu_buffer_reallocs",
+};
+
+void appendEscaped(std::ostringstream& out, const std::string& s) {
+    for (char c : s) {
+        if (c == '"' || c == '\\') out << '\\';
+        if (static_cast<unsigned char>(c) >= 0x20) out << c;
+    }
+}
+
+}
+
+const char* counterName(Counter counter) {
+    size_t i = static_cast<size_t>(counter);
+    return i < kCounters ? kCounterNames[i] : "unknown";
+}
+
+double Snapshot::cpuImbalance() const {
+    uint64_t max = 0, sum = 0, n = 0;
+    for (const ThreadSnapshot& t : threads) {
+        uint64_t busy = t[Counter::CpuBusyNs];
+        if (!busy) continue;
+        max = std::max(max, busy);
+        sum += busy;
+        n++;
+    }
+    return sum ? static_cast<double>(max) * n / sum : 1.0;
+}
+
+#if PS_ENABLE_METRICS
+
+namespace {
+
+struct TraceEvent {
+    const char* name;
+    uint64_t start;
+    uint64_t end;
+};
+
+struct ThreadBlock {
+    std::atomic<uint64_t> values[kCounters] = {};
+    unsigned tid = 0;
+    std::string name;  // guarded by Registry::m
+    std::unique_ptr<TraceEvent[]> ring;
+    std::atomic<TraceEvent*> ring_ptr{nullptr};
+    std::atomic<uint64_t> written{0};
+};
+
+struct Registry {
+    std::mutex m;
+    std::deque<std::unique_ptr<ThreadBlock>> blocks;
+};
+
+// Never destroyed: pool threads may still record during static destruction.
+Registry& registry() {
+    static Registry* r = new Registry;
+    return *r;
+}
+
+std::atomic<bool> g_tracing{false};
+
+ThreadBlock& local() {
+    thread_local ThreadBlock* block = nullptr;
+    if (!block) {
+        Registry& r = registry();
+        std::lock_guard<std::mutex> lk(r.m);
+        r.blocks.push_back(std::make_unique<ThreadBlock>());
+        block = r.blocks.back().get();
+        block->tid = static_cast<unsigned>(r.blocks.size());
+        block->name = "thread " + std::to_string(block->tid);
+    }
+    return *block;
+}
+
+}
+
+uint64_t nowNs() {
+    static const auto epoch = std::chrono::steady_clock::now();
+    return std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - epoch).count();
+}
+
+void add(Counter counter, uint64_t value) {
+    local().values[static_cast<size_t>(counter)].fetch_add(value, std::memory_order_relaxed);
+}
+
+void setThreadName(const std::string& name) {
+    ThreadBlock& block = local();
+    std::lock_guard<std::mutex> lk(registry().m);
+    block.name = name;
+}
+
+void setTracing(bool enabled) {
+    g_tracing.store(enabled, std::memory_order_relaxed);
+}
+
+bool tracing() {
+    return g_tracing.load(std::memory_order_relaxed);
+}
+
+void traceSpan(const char* name, uint64_t start_ns, uint64_t end_ns) {
+    ThreadBlock& block = local();
+    TraceEvent* ring = block.ring_ptr.load(std::memory_order_relaxed);
+    if (!ring) {
+        block.ring.reset(new TraceEvent[kTraceCapacity]);
+        ring = block.ring.get();
+        block.ring_ptr.store(ring, std::memory_order_release);
+    }
+    uint64_t i = block.written.load(std::memory_order_relaxed);
+    ring[i % kTraceCapacity] = TraceEvent{name, start_ns, end_ns};
+    block.written.store(i + 1, std::memory_order_release);
+}
+
+Snapshot snapshot() {
+    Snapshot snap;
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    for (const auto& block : r.blocks) {
+        ThreadSnapshot t;
+        t.name = block->name;
+        bool any = false;
+        for (size_t i = 0; i < kCounters; i++) {
+            t.values[i] = block->values[i].load(std::memory_order_relaxed);
+            snap.totals[i] += t.values[i];
+            any = any || t.values[i];
+        }
+        if (any) snap.threads.push_back(std::move(t));
+    }
+    return snap;
+}
+
+void reset() {
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    for (const auto& block : r.blocks) {
+        for (auto& v : block->values) v.store(0, std::memory_order_relaxed);
+        block->written.store(0, std::memory_order_relaxed);
+    }
+}
+
+// Meant to be called while nothing is recording: a thread that wraps its
+// ring during the export can make its oldest events come out mixed.
+std::string chromeTrace() {
+    std::ostringstream out;
+    out << std::fixed << std::setprecision(3) << "{\"traceEvents\":[";
+    bool first = true;
+    auto separator = [&] {
+        if (!first) out << ',';
+        first = false;
+    };
+
+    Registry& r = registry();
+    std::lock_guard<std::mutex> lk(r.m);
+    for (const auto& block : r.blocks) {
+        uint64_t written = block->written.load(std::memory_order_acquire);
+        TraceEvent* ring = block->ring_ptr.load(std::memory_order_acquire);
+        if (!ring || !written) continue;
+
+        separator();
+        out << "{\"name\":\"thread_name\",\"ph\":\"M\",\"pid\":1,\"tid\":" << block->tid << ",\"args\":{\"name\":\"";
+        appendEscaped(out, block->name);
+        out << "\"}}";
+
+        uint64_t begin = written > kTraceCapacity ? written - kTraceCapacity : 0;
+        for (uint64_t i = begin; i < written; i++) {
+            const TraceEvent& e = ring[i % kTraceCapacity];
+            separator();
+            out << "{\"name\":\"";
+            appendEscaped(out, e.name);
+            out << "\",\"ph\":\"X\",\"pid\":1,\"tid\":" << block->tid << ",\"ts\":" << e.start / 1000.0
+                << ",\"dur\":" << (e.end - e.start) / 1000.0 << '}';
+        }
+    }
+    out << "]}";
+    return out.str();
+}
+
+#else
+
+Snapshot snapshot() { return Snapshot(); }
+void reset() {}
+std::string chromeTrace() { return "{\"traceEvents\":[]}"; }
+
+#endif
+
+bool writeChromeTrace(const std::string& path) {
+    std::ofstream f(path, std::ios::trunc);
+    if (!f) return false;
+    f << chromeTrace();
+    return static_cast<bool>(f);
+}
+
+}
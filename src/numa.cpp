@@ -0,0 +1,134 @@
+#include "numa.h"
+#include <algorithm>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <thread>
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#include <windows.h>
+#elif defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace numa {
+
+namespace {
+
+// "0-3,8,10-11" -> {0, 1, 2, 3, 8, 10, 11}
+std::vector<unsigned> parseCpuList(const std::string& list) {
+    std::vector<unsigned> cpus;
+    std::stringstream ss(list);
+    std::string item;
+    while (std::getline(ss, item, ',')) {
+        if (item.empty() || item == "\n") continue;
+        size_t dash = item.find('-');
+        try {
+            unsigned first = static_cast<unsigned>(std::stoul(item.substr(0, dash)));
+            unsigned last = dash == std::string::npos ? first : static_cast<unsigned>(std::stoul(item.substr(dash + 1)));
+            for (unsigned c = first; c <= last; c++) cpus.push_back(c);
+        } catch (const std::exception&) {
+            return {};
+        }
+    }
+    return cpus;
+}
+
+bool usable(unsigned cpu) {
+#ifdef __linux__
+    static cpu_set_t mask;
+    static bool have_mask = sched_getaffinity(0, sizeof(mask), &mask) == 0;
+    return !have_mask || cpu >= CPU_SETSIZE || CPU_ISSET(cpu, &mask);
+#else
+    (void)cpu;
+    return true;
+#endif
+}
+
+Topology detect() {
+    Topology topo;
+#ifdef __linux__
+    std::ifstream online("/sys/devices/system/node/online");
+    std::string nodes;
+    if (online && std::getline(online, nodes)) {
+        for (unsigned node : parseCpuList(nodes)) {
+            std::ifstream f("/sys/devices/system/node/node" + std::to_string(node) + "/cpulist");
+            std::string list;
+            if (!f || !std::getline(f, list)) continue;
+            std::vector<unsigned> cpus;
+            for (unsigned cpu : parseCpuList(list))
+                if (usable(cpu)) cpus.push_back(cpu);
+            if (!cpus.empty()) topo.node_cpus.push_back(std::move(cpus));
+        }
+    }
+#endif
+    if (topo.node_cpus.empty()) {
+        unsigned n = std::max(1u, std::thread::hardware_concurrency());
+        std::vector<unsigned> cpus;
+        for (unsigned c = 0; c < n; c++)
+            if (usable(c)) cpus.push_back(c);
+        if (cpus.empty()) cpus.push_back(0);
+        topo.node_cpus.push_back(std::move(cpus));
+    }
+    return topo;
+}
+
+// Position of worker `index` in the node-ordered list of all CPUs.
+unsigned flatIndex(unsigned index, unsigned count) {
+    unsigned total = topology().cpus();
+    if (count == 0) return 0;
+    return static_cast<unsigned>(static_cast<unsigned long long>(index % count) * total / count);
+}
+
+}
+
+unsigned Topology::cpus() const {
+    unsigned n = 0;
+    for (const auto& cpus : node_cpus) n += static_cast<unsigned>(cpus.size());
+    return n;
+}
+
+const Topology& topology() {
+    static const Topology topo = detect();
+    return topo;
+}
+
+unsigned cpuForWorker(unsigned index, unsigned count) {
+    unsigned flat = flatIndex(index, count);
+    for (const auto& cpus : topology().node_cpus) {
+        if (flat < cpus.size()) return cpus[flat];
+        flat -= static_cast<unsigned>(cpus.size());
+    }
+    return topology().node_cpus.front().front();
+}
+
+unsigned nodeForWorker(unsigned index, unsigned count) {
+    unsigned flat = flatIndex(index, count);
+    const Topology& topo = topology();
+    for (unsigned node = 0; node < topo.nodes(); node++) {
+        if (flat < topo.node_cpus[node].size()) return node;
+        flat -= static_cast<unsigned>(topo.node_cpus[node].size());
+    }
+    return 0;
+}
+
+bool pinThread(std::thread& thread, unsigned cpu) {
+#ifdef __linux__
+    if (cpu >= CPU_SETSIZE) return false;
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    CPU_SET(cpu, &set);
+    return pthread_setaffinity_np(thread.native_handle(), sizeof(set), &set) == 0;
+#elif defined(_WIN32)
+    if (cpu >= sizeof(DWORD_PTR) * 8) return false;
+    return SetThreadAffinityMask(thread.native_handle(), DWORD_PTR(1) << cpu) != 0;
+#else
+    (void)thread;
+    (void)cpu;
+    return false;
+#endif
+}
+
+}
@@ -0,0 +1,217 @@
+#include "program_cache.h"
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <fstream>
+#include <stdexcept>
+#include <vector>
+
+#ifdef _WIN32
+#include <process.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace {
+
+// Header of a cached binary, followed by key_length bytes of key (driver and
+// source, compared in full on load: the file name is only a hash of them)
+// and length bytes of binary.
+struct BinaryHeader {
+    char magic[4] = {'P', 'S', 'P', '2'};
+    uint32_t format = 0;
+    uint32_t length = 0;
+    uint32_t key_length = 0;
+};
+
+// Unique among processes sharing the directory and threads within one.
+std::string tempSuffix() {
+    static std::atomic<unsigned> counter{0};
+#ifdef _WIN32
+    long pid = _getpid();
+#else
+    long pid = getpid();
+#endif
+    return "." + std::to_string(pid) + "." + std::to_string(counter++) + ".tmp";
+}
+
+uint64_t fnv1a(const std::string& text, uint64_t hash = 14695981039346656037ull) {
+    for (unsigned char c : text) {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+    return hash;
+}
+
+std::string glString(GLenum name) {
+    const GLubyte* s = glGetString(name);
+    return s ? reinterpret_cast<const char*>(s) : "";
+}
+
+GLuint compileComputeProgram(const std::string& src, bool retrievable) {
+    const char* source = src.c_str();
+
+    GLuint shader = glCreateShader(GL_COMPUTE_SHADER);
+    glShaderSource(shader, 1, &source, nullptr);
+    glCompileShader(shader);
+
+    GLint success;
+    glGetShaderiv(shader, GL_COMPILE_STATUS, &success);
+    if (!success) {
+        char log[512];
+        glGetShaderInfoLog(shader, 512, nullptr, log);
+        glDeleteShader(shader);
+        throw std::runtime_error(std::string("Compute shader compilation failed: ") + log);
+    }
+
+    GLuint program = glCreateProgram();
+    if (retrievable) glProgramParameteri(program, GL_PROGRAM_BINARY_RETRIEVABLE_HINT, GL_TRUE);
+    glAttachShader(program, shader);
+    glLinkProgram(program);
+    glDeleteShader(shader);
+
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        char log[512];
+        glGetProgramInfoLog(program, 512, nullptr, log);
+        glDeleteProgram(program);
+        throw std::runtime_error(std::string("Shader program linking failed: ") + log);
+    }
+    return program;
+}
+
+}
+
+ProgramCache::ProgramCache(std::string directory) : g_directory(std::move(directory)) {}
+
+std::string ProgramCache::defaultDirectory() {
+    if (const char* dir = std::getenv("PS_SHADER_CACHE")) return dir;
+#ifdef _WIN32
+    if (const char* local = std::getenv("LOCALAPPDATA")) return std::string(local) + "\\ps-shaders";
+#else
+    if (const char* xdg = std::getenv("XDG_CACHE_HOME"); xdg && *xdg) return std::string(xdg) + "/ps-shaders";
+    if (const char* home = std::getenv("HOME"); home && *home) return std::string(home) + "/.cache/ps-shaders";
+#endif
+    return "";
+}
+
+const ProgramCache::Program& ProgramCache::get(const std::string& source) {
+    auto it = g_programs.find(source);
+    if (it != g_programs.end()) {
+        g_stats.reused++;
+        return it->second;
+    }
+
+    if (g_driver.empty()) {
+        g_driver = glString(GL_VENDOR) + "\n" + glString(GL_RENDERER) + "\n" + glString(GL_VERSION);
+        GLint formats = 0;
+        glGetIntegerv(GL_NUM_PROGRAM_BINARY_FORMATS, &formats);
+        g_binaries_supported = formats > 0;
+    }
+
+    bool use_disk = g_binaries_supported && !g_directory.empty();
+    std::string key = use_disk ? g_driver + "\n" + source : "";
+    std::string path = use_disk ? binaryPath(key) : "";
+    GLuint id = use_disk ? loadBinary(path, key) : 0;
+    if (id) {
+        g_stats.loaded++;
+    } else {
+        id = compileComputeProgram(source, use_disk);
+        g_stats.compiled++;
+        if (use_disk) storeBinary(path, key, id);
+    }
+
+    Program program;
+    program.id = id;
+    program.groups_x = glGetUniformLocation(id, "u_GroupsX");
+    program.count = glGetUniformLocation(id, "u_Count");
+    program.hist_lo = glGetUniformLocation(id, "u_HistLo");
+    program.hist_scale = glGetUniformLocation(id, "u_HistScale");
+    program.hist_bins = glGetUniformLocation(id, "u_HistBins");
+    program.arrays = glGetUniformLocation(id, "u_Arrays");
+    return g_programs.emplace(source, program).first->second;
+}
+
+void ProgramCache::clear() {
+    for (auto& entry : g_programs) glDeleteProgram(entry.second.id);
+    g_programs.clear();
+}
+
+std::string ProgramCache::binaryPath(const std::string& key) {
+    char name[32];
+    std::snprintf(name, sizeof(name), "%016llx.bin", static_cast<unsigned long long>(fnv1a(key)));
+    return (std::filesystem::path(g_directory) / name).string();
+}
+
+GLuint ProgramCache::loadBinary(const std::string& path, const std::string& key) {
+    std::ifstream file(path, std::ios::binary);
+    if (!file) return 0;
+
+    // A hash collision or a file copied under another name must not relink
+    // the wrong program, so the stored key has to match exactly.
+    BinaryHeader header;
+    BinaryHeader expected;
+    std::vector<char> binary;
+    if (file.read(reinterpret_cast<char*>(&header), sizeof(header)) &&
+        std::equal(header.magic, header.magic + 4, expected.magic) && header.length > 0 &&
+        header.key_length == key.size()) {
+        std::string stored(key.size(), '\0');
+        if (file.read(&stored[0], stored.size()) && stored == key) {
+            binary.resize(header.length);
+            if (!file.read(binary.data(), binary.size())) binary.clear();
+        }
+    }
+    if (binary.empty()) return 0;
+
+    // Drivers reject binaries from other builds with a failed link status.
+    GLuint program = glCreateProgram();
+    glProgramBinary(program, header.format, binary.data(), static_cast<GLsizei>(binary.size()));
+    GLint success = GL_FALSE;
+    glGetProgramiv(program, GL_LINK_STATUS, &success);
+    if (!success) {
+        glDeleteProgram(program);
+        return 0;
+    }
+    return program;
+}
+
+void ProgramCache::storeBinary(const std::string& path, const std::string& key, GLuint program) {
+    GLint length = 0;
+    glGetProgramiv(program, GL_PROGRAM_BINARY_LENGTH, &length);
+    if (length <= 0) return;
+
+    BinaryHeader header;
+    std::vector<char> binary(static_cast<size_t>(length));
+    GLenum format = 0;
+    glGetProgramBinary(program, length, &length, &format, binary.data());
+    if (length <= 0) return;
+    header.format = format;
+    header.length = static_cast<uint32_t>(length);
+    header.key_length = static_cast<uint32_t>(key.size());
+
+    // Write to a private name and rename, so a concurrent reader sees either
+    // no file or a whole one.
+    std::error_code ec;
+    std::filesystem::create_directories(g_directory, ec);
+    std::string tmp = path + tempSuffix();
+    {
+        std::ofstream file(tmp, std::ios::binary);
+        if (!file) return;
+        file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+        file.write(key.data(), key.size());
+        file.write(binary.data(), length);
+        if (!file) {
+            file.close();
+            std::filesystem::remove(tmp, ec);
+            return;
+        }
+    }
+    std::filesystem::rename(tmp, path, ec);
+    if (ec) {
+        std::filesystem::remove(tmp, ec);
+        return;
+    }
+    g_stats.stored++;
+}
@@ -0,0 +1,98 @@
+#include "simd_transform.h"
+#include "simd_transform_impl.h"
+#include <atomic>
+#include <cmath>
+
+#if defined(PS_SIMD_X86) && defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+namespace simd {
+namespace {
+
+#if defined(PS_SIMD_X86) && defined(_MSC_VER)
+bool cpuHas(int leaf, int reg, int bit) {
+    int info[4];
+    __cpuidex(info, leaf, 0);
+    return (info[reg] >> bit) & 1;
+}
+
+Level detectLevelMSVC() {
+    // OSXSAVE + AVX, then check the OS saves YMM (and ZMM) state.
+    if (!cpuHas(1, 2, 27) || !cpuHas(1, 2, 28)) return Level::SSE2;
+    unsigned long long xcr0 = _xgetbv(0);
+    bool ymm = (xcr0 & 0x6) == 0x6;
+    bool zmm = (xcr0 & 0xe6) == 0xe6;
+    if (ymm && zmm && cpuHas(7, 1, 16)) return Level::AVX512;
+    if (ymm && cpuHas(7, 1, 5) && cpuHas(1, 2, 12) && cpuHas(1, 2, 29)) return Level::AVX2;
+    return Level::SSE2;
+}
+#endif
+
+void transformScalarBlock(float* data, size_t count) {
+    for (size_t i = 0; i < count; i++) data[i] = transformScalar(data[i]);
+}
+
+using BlockFn = void (*)(float*, size_t);
+
+BlockFn blockFor(Level level) {
+    switch (level) {
+#if defined(PS_SIMD_X86)
+    case Level::AVX512: return transformAVX512;
+    case Level::AVX2: return transformAVX2;
+    case Level::SSE2: return transformSSE2;
+#endif
+    default: return transformScalarBlock;
+    }
+}
+
+std::atomic<Level> g_level{detectLevel()};
+std::atomic<BlockFn> g_block{blockFor(detectLevel())};
+
+}
+
+Level detectLevel() {
+#if defined(PS_SIMD_X86) && defined(_MSC_VER)
+    static const Level level = detectLevelMSVC();
+    return level;
+#elif defined(PS_SIMD_X86)
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx512f")) return Level::AVX512;
+    if (__builtin_cpu_supports("avx2") && __builtin_cpu_supports("fma") && __builtin_cpu_supports("f16c"))
+        return Level::AVX2;
+    return Level::SSE2;
+#else
+    return Level::Scalar;
+#endif
+}
+
+Level activeLevel() {
+    return g_level.load(std::memory_order_relaxed);
+}
+
+void setLevel(Level level) {
+    if (static_cast<int>(level) > static_cast<int>(detectLevel())) level = detectLevel();
+    g_level.store(level, std::memory_order_relaxed);
+    g_block.store(blockFor(level), std::memory_order_relaxed);
+}
+
+const char* levelName(Level level) {
+    switch (level) {
+    case Level::Scalar: return "scalar";
+    case Level::SSE2: return "sse2";
+    case Level::AVX2: return "avx2";
+    case Level::AVX512: return "avx512";
+    }
+    return "unknown";
+}
+
+void transform(float* data, size_t count) {
+    g_block.load(std::memory_order_relaxed)(data, count);
+}
+
+float transformScalar(float x) {
+    // Example computation x = 64 -> f(x) = 9.298
+    return std::sqrt(x) + std::sin(x) * std::cos(x) + std::exp(-x * 0.001f);
+}
+
+}
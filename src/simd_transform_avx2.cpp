@@ -0,0 +1,89 @@
+#include "simd_transform_impl.h"
+#include "simd_transform.h"
+#include <immintrin.h>
+
+// Built with -mavx2 -mfma -mf16c; only called once detectLevel() reports AVX2.
+namespace simd {
+namespace {
+
+struct VecAVX2 {
+    using F = __m256;
+    using I = __m256i;
+    using M = __m256;
+    static constexpr int width = 8;
+
+    static F set1(float v) { return _mm256_set1_ps(v); }
+    static F load(const float* p) { return _mm256_loadu_ps(p); }
+    static void store(float* p, F v) { _mm256_storeu_ps(p, v); }
+
+    static F add(F a, F b) { return _mm256_add_ps(a, b); }
+    static F mul(F a, F b) { return _mm256_mul_ps(a, b); }
+    static F fmadd(F a, F b, F c) { return _mm256_fmadd_ps(a, b, c); }
+    static F fnmadd(F a, F b, F c) { return _mm256_fnmadd_ps(a, b, c); }
+    static F sqrt(F a) { return _mm256_sqrt_ps(a); }
+    static F min(F a, F b) { return _mm256_min_ps(a, b); }
+    static F max(F a, F b) { return _mm256_max_ps(a, b); }
+    static F abs(F a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+
+    static I roundToInt(F a) { return _mm256_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm256_cvtepi32_ps(a); }
+    static F pow2(I n) { return _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_add_epi32(n, _mm256_set1_epi32(127)), 23)); }
+
+    static M oddMask(I q) {
+        I one = _mm256_set1_epi32(1);
+        return _mm256_castsi256_ps(_mm256_cmpeq_epi32(_mm256_and_si256(q, one), one));
+    }
+    static F flipSign(F v, I q) {
+        return _mm256_xor_ps(v, _mm256_castsi256_ps(_mm256_slli_epi32(_mm256_and_si256(q, _mm256_set1_epi32(2)), 30)));
+    }
+
+    static M greater(F a, F b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+    static F select(M m, F a, F b) { return _mm256_blendv_ps(b, a, m); }
+    static bool any(M m) { return _mm256_movemask_ps(m) != 0; }
+    static bool laneSet(M m, int lane) { return (_mm256_movemask_ps(m) >> lane) & 1; }
+};
+
+}
+
+void transformAVX2(float* data, size_t count) {
+    detail::transformBlock<VecAVX2>(data, count, transformScalar);
+}
+
+void halfToFloatAVX2(const uint16_t* src, size_t count, float* dst) {
+    detail::convertBlock<8>(src, count, dst, [](const uint16_t* in, float* out) {
+        _mm256_storeu_ps(out, _mm256_cvtph_ps(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in))));
+    });
+}
+
+void floatToHalfAVX2(const float* src, size_t count, uint16_t* dst) {
+    detail::convertBlock<8>(src, count, dst, [](const float* in, uint16_t* out) {
+        __m128i h = _mm256_cvtps_ph(_mm256_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), h);
+    });
+}
+
+void bf16ToFloatAVX2(const uint16_t* src, size_t count, float* dst) {
+    detail::convertBlock<8>(src, count, dst, [](const uint16_t* in, float* out) {
+        __m256i w = _mm256_cvtepu16_epi32(_mm_loadu_si128(reinterpret_cast<const __m128i*>(in)));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm256_slli_epi32(w, 16));
+    });
+}
+
+void floatToBf16AVX2(const float* src, size_t count, uint16_t* dst) {
+    detail::convertBlock<8>(src, count, dst, [](const float* in, uint16_t* out) {
+        // Round to nearest even on the bits; NaNs keep their top bits, made quiet.
+        __m256 v = _mm256_loadu_ps(in);
+        __m256i x = _mm256_castps_si256(v);
+        __m256i high = _mm256_srli_epi32(x, 16);
+        __m256i bias = _mm256_add_epi32(_mm256_and_si256(high, _mm256_set1_epi32(1)), _mm256_set1_epi32(0x7fff));
+        __m256i rounded = _mm256_srli_epi32(_mm256_add_epi32(x, bias), 16);
+        __m256i quiet = _mm256_or_si256(high, _mm256_set1_epi32(0x40));
+        __m256i nan = _mm256_castps_si256(_mm256_cmp_ps(v, v, _CMP_UNORD_Q));
+        __m256i bits = _mm256_blendv_epi8(rounded, quiet, nan);
+        // packus narrows within each 128-bit lane; gather the two low halves.
+        __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi32(bits, bits), 0x08);
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(out), _mm256_castsi256_si128(packed));
+    });
+}
+
+}
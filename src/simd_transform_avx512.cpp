@@ -0,0 +1,87 @@
+#include "simd_transform_impl.h"
+#include "simd_transform.h"
+#include <immintrin.h>
+
+// Built with -mavx512f; only called once detectLevel() reports AVX512. Sticks to
+// AVX-512F (no DQ), so the float xor goes through the integer unit.
+namespace simd {
+namespace {
+
+struct VecAVX512 {
+    using F = __m512;
+    using I = __m512i;
+    using M = __mmask16;
+    static constexpr int width = 16;
+
+    static F set1(float v) { return _mm512_set1_ps(v); }
+    static F load(const float* p) { return _mm512_loadu_ps(p); }
+    static void store(float* p, F v) { _mm512_storeu_ps(p, v); }
+
+    static F add(F a, F b) { return _mm512_add_ps(a, b); }
+    static F mul(F a, F b) { return _mm512_mul_ps(a, b); }
+    static F fmadd(F a, F b, F c) { return _mm512_fmadd_ps(a, b, c); }
+    static F fnmadd(F a, F b, F c) { return _mm512_fnmadd_ps(a, b, c); }
+    static F sqrt(F a) { return _mm512_sqrt_ps(a); }
+    static F min(F a, F b) { return _mm512_min_ps(a, b); }
+    static F max(F a, F b) { return _mm512_max_ps(a, b); }
+    static F abs(F a) {
+        return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff)));
+    }
+
+    static I roundToInt(F a) { return _mm512_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm512_cvtepi32_ps(a); }
+    static F pow2(I n) { return _mm512_castsi512_ps(_mm512_slli_epi32(_mm512_add_epi32(n, _mm512_set1_epi32(127)), 23)); }
+
+    static M oddMask(I q) { return _mm512_test_epi32_mask(q, _mm512_set1_epi32(1)); }
+    static F flipSign(F v, I q) {
+        I sign = _mm512_slli_epi32(_mm512_and_si512(q, _mm512_set1_epi32(2)), 30);
+        return _mm512_castsi512_ps(_mm512_xor_si512(_mm512_castps_si512(v), sign));
+    }
+
+    static M greater(F a, F b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+    static F select(M m, F a, F b) { return _mm512_mask_blend_ps(m, b, a); }
+    static bool any(M m) { return m != 0; }
+    static bool laneSet(M m, int lane) { return (m >> lane) & 1; }
+};
+
+}
+
+void transformAVX512(float* data, size_t count) {
+    detail::transformBlock<VecAVX512>(data, count, transformScalar);
+}
+
+void halfToFloatAVX512(const uint16_t* src, size_t count, float* dst) {
+    detail::convertBlock<16>(src, count, dst, [](const uint16_t* in, float* out) {
+        _mm512_storeu_ps(out, _mm512_cvtph_ps(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in))));
+    });
+}
+
+void floatToHalfAVX512(const float* src, size_t count, uint16_t* dst) {
+    detail::convertBlock<16>(src, count, dst, [](const float* in, uint16_t* out) {
+        __m256i h = _mm512_cvtps_ph(_mm512_loadu_ps(in), _MM_FROUND_TO_NEAREST_INT);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), h);
+    });
+}
+
+void bf16ToFloatAVX512(const uint16_t* src, size_t count, float* dst) {
+    detail::convertBlock<16>(src, count, dst, [](const uint16_t* in, float* out) {
+        __m512i w = _mm512_cvtepu16_epi32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in)));
+        _mm512_storeu_si512(out, _mm512_slli_epi32(w, 16));
+    });
+}
+
+void floatToBf16AVX512(const float* src, size_t count, uint16_t* dst) {
+    detail::convertBlock<16>(src, count, dst, [](const float* in, uint16_t* out) {
+        // Same rounding as floatToBf16AVX2.
+        __m512 v = _mm512_loadu_ps(in);
+        __m512i x = _mm512_castps_si512(v);
+        __m512i high = _mm512_srli_epi32(x, 16);
+        __m512i bias = _mm512_add_epi32(_mm512_and_si512(high, _mm512_set1_epi32(1)), _mm512_set1_epi32(0x7fff));
+        __m512i rounded = _mm512_srli_epi32(_mm512_add_epi32(x, bias), 16);
+        __m512i quiet = _mm512_or_si512(high, _mm512_set1_epi32(0x40));
+        __m512i bits = _mm512_mask_mov_epi32(rounded, _mm512_cmp_ps_mask(v, v, _CMP_UNORD_Q), quiet);
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(out), _mm512_cvtepi32_epi16(bits));
+    });
+}
+
+}
@@ -0,0 +1,159 @@
+#pragma once
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+
+// Shared body of the vectorized transform. Each simd_transform_<isa>.cpp is
+// built with its own -m flags, defines a register wrapper V and instantiates
+// transformBlock<V>; the AVX2 and AVX-512 ones also hold the 16-bit float
+// conversions behind half.h. Keep this header free of non-template inline functions:
+// they would be compiled with different instruction sets per TU and the linker
+// may keep the wrong copy.
+namespace simd {
+
+void transformSSE2(float* data, size_t count);
+void transformAVX2(float* data, size_t count);
+void transformAVX512(float* data, size_t count);
+
+void halfToFloatAVX2(const uint16_t* src, size_t count, float* dst);
+void floatToHalfAVX2(const float* src, size_t count, uint16_t* dst);
+void bf16ToFloatAVX2(const uint16_t* src, size_t count, float* dst);
+void floatToBf16AVX2(const float* src, size_t count, uint16_t* dst);
+void halfToFloatAVX512(const uint16_t* src, size_t count, float* dst);
+void floatToHalfAVX512(const float* src, size_t count, uint16_t* dst);
+void bf16ToFloatAVX512(const uint16_t* src, size_t count, float* dst);
+void floatToBf16AVX512(const float* src, size_t count, uint16_t* dst);
+
+namespace detail {
+
+struct Constants {
+    // sin(2x) reduction by pi/2 in three parts; k * kPio2_1 is exact for k < 2^16.
+    static constexpr float kTwoOverPi = 0.636619772367581343f;
+    static constexpr float kPio2_1 = 1.5703125f;
+    static constexpr float kPio2_2 = 4.837512969970703125e-4f;
+    static constexpr float kPio2_3 = 7.54978995489188216e-8f;
+    // Largest x whose 2x the reduction handles; past it the element goes to libm.
+    static constexpr float kMaxInput = 32768.0f;
+
+    static constexpr float kSin1 = -1.6666654611e-1f;
+    static constexpr float kSin2 = 8.3321608736e-3f;
+    static constexpr float kSin3 = -1.9515295891e-4f;
+    static constexpr float kCos1 = 4.166664568298827e-2f;
+    static constexpr float kCos2 = -1.388731625493765e-3f;
+    static constexpr float kCos3 = 2.443315711809948e-5f;
+
+    static constexpr float kExpLo = -87.3365447505f;
+    static constexpr float kExpHi = 88.3762626647f;
+    static constexpr float kLog2e = 1.44269504088896341f;
+    static constexpr float kLn2Hi = 0.693359375f;
+    static constexpr float kLn2Lo = -2.12194440e-4f;
+    static constexpr float kExp0 = 1.9875691500e-4f;
+    static constexpr float kExp1 = 1.3981999507e-3f;
+    static constexpr float kExp2 = 8.3334519073e-3f;
+    static constexpr float kExp3 = 4.1665795894e-2f;
+    static constexpr float kExp4 = 1.6666665459e-1f;
+    static constexpr float kExp5 = 5.0000001201e-1f;
+};
+
+template <class V>
+typename V::F transformVec(typename V::F x) {
+    using F = typename V::F;
+    using I = typename V::I;
+    using C = Constants;
+
+    F root = V::sqrt(x);
+
+    // 0.5 * sin(y), y = 2x
+    F y = V::add(x, x);
+    I q = V::roundToInt(V::mul(y, V::set1(C::kTwoOverPi)));
+    F k = V::toFloat(q);
+    F r = V::fnmadd(k, V::set1(C::kPio2_1), y);
+    r = V::fnmadd(k, V::set1(C::kPio2_2), r);
+    r = V::fnmadd(k, V::set1(C::kPio2_3), r);
+    F r2 = V::mul(r, r);
+
+    F ps = V::fmadd(r2, V::set1(C::kSin3), V::set1(C::kSin2));
+    ps = V::fmadd(ps, r2, V::set1(C::kSin1));
+    ps = V::fmadd(V::mul(ps, r2), r, r);
+
+    F pc = V::fmadd(r2, V::set1(C::kCos3), V::set1(C::kCos2));
+    pc = V::fmadd(pc, r2, V::set1(C::kCos1));
+    pc = V::fmadd(V::mul(pc, r2), r2, V::fnmadd(V::set1(0.5f), r2, V::set1(1.0f)));
+
+    F sin_y = V::flipSign(V::select(V::oddMask(q), pc, ps), q);
+    F sincos = V::mul(sin_y, V::set1(0.5f));
+
+    // exp(z), z = -0.001x
+    F z = V::mul(x, V::set1(-0.001f));
+    z = V::max(V::min(z, V::set1(C::kExpHi)), V::set1(C::kExpLo));
+    I n = V::roundToInt(V::mul(z, V::set1(C::kLog2e)));
+    F fn = V::toFloat(n);
+    F t = V::fnmadd(fn, V::set1(C::kLn2Hi), z);
+    t = V::fnmadd(fn, V::set1(C::kLn2Lo), t);
+    F t2 = V::mul(t, t);
+
+    F pe = V::fmadd(t, V::set1(C::kExp0), V::set1(C::kExp1));
+    pe = V::fmadd(pe, t, V::set1(C::kExp2));
+    pe = V::fmadd(pe, t, V::set1(C::kExp3));
+    pe = V::fmadd(pe, t, V::set1(C::kExp4));
+    pe = V::fmadd(pe, t, V::set1(C::kExp5));
+    pe = V::fmadd(pe, t2, V::add(t, V::set1(1.0f)));
+    F e = V::mul(pe, V::pow2(n));
+
+    return V::add(V::add(root, sincos), e);
+}
+
+template <class V>
+void transformStore(float* out, typename V::F x, float (*fallback)(float)) {
+    typename V::F result = transformVec<V>(x);
+    V::store(out, result);
+
+    // Rare: 2x is past the range the reduction is accurate for. Redo those
+    // lanes with libm from the saved inputs.
+    auto big = V::greater(V::abs(x), V::set1(Constants::kMaxInput));
+    if (V::any(big)) {
+        float in[V::width];
+        V::store(in, x);
+        for (int lane = 0; lane < V::width; lane++) {
+            if (V::laneSet(big, lane)) out[lane] = fallback(in[lane]);
+        }
+    }
+}
+
+template <class V>
+void transformBlock(float* data, size_t count, float (*fallback)(float)) {
+    size_t i = 0;
+    for (; i + V::width <= count; i += V::width)
+        transformStore<V>(data + i, V::load(data + i), fallback);
+
+    // Tail goes through the same vector code on a padded copy, so an element's
+    // result does not depend on where it sits in the array.
+    size_t rest = count - i;
+    if (rest) {
+        float tmp[V::width];
+        for (int lane = 0; lane < V::width; lane++) tmp[lane] = 1.0f;
+        std::memcpy(tmp, data + i, rest * sizeof(float));
+        transformStore<V>(tmp, V::load(tmp), fallback);
+        std::memcpy(data + i, tmp, rest * sizeof(float));
+    }
+}
+
+// Applies fn, which converts W elements from in to out, over count
+// elements. The tail goes through a zero-padded copy, as in transformBlock.
+template <int W, class Src, class Dst, class Fn>
+void convertBlock(const Src* src, size_t count, Dst* dst, Fn fn) {
+    size_t i = 0;
+    for (; i + W <= count; i += W) fn(src + i, dst + i);
+
+    size_t rest = count - i;
+    if (rest) {
+        Src in[W] = {};
+        Dst out[W];
+        std::memcpy(in, src + i, rest * sizeof(Src));
+        fn(in, out);
+        std::memcpy(dst + i, out, rest * sizeof(Dst));
+    }
+}
+
+}
+}
@@ -0,0 +1,51 @@
+#include "simd_transform_impl.h"
+#include "simd_transform.h"
+#include <emmintrin.h>
+
+namespace simd {
+namespace {
+
+struct VecSSE2 {
+    using F = __m128;
+    using I = __m128i;
+    using M = __m128;
+    static constexpr int width = 4;
+
+    static F set1(float v) { return _mm_set1_ps(v); }
+    static F load(const float* p) { return _mm_loadu_ps(p); }
+    static void store(float* p, F v) { _mm_storeu_ps(p, v); }
+
+    static F add(F a, F b) { return _mm_add_ps(a, b); }
+    static F mul(F a, F b) { return _mm_mul_ps(a, b); }
+    static F fmadd(F a, F b, F c) { return _mm_add_ps(_mm_mul_ps(a, b), c); }
+    static F fnmadd(F a, F b, F c) { return _mm_sub_ps(c, _mm_mul_ps(a, b)); }
+    static F sqrt(F a) { return _mm_sqrt_ps(a); }
+    static F min(F a, F b) { return _mm_min_ps(a, b); }
+    static F max(F a, F b) { return _mm_max_ps(a, b); }
+    static F abs(F a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+
+    static I roundToInt(F a) { return _mm_cvtps_epi32(a); }
+    static F toFloat(I a) { return _mm_cvtepi32_ps(a); }
+    static F pow2(I n) { return _mm_castsi128_ps(_mm_slli_epi32(_mm_add_epi32(n, _mm_set1_epi32(127)), 23)); }
+
+    static M oddMask(I q) {
+        I one = _mm_set1_epi32(1);
+        return _mm_castsi128_ps(_mm_cmpeq_epi32(_mm_and_si128(q, one), one));
+    }
+    static F flipSign(F v, I q) {
+        return _mm_xor_ps(v, _mm_castsi128_ps(_mm_slli_epi32(_mm_and_si128(q, _mm_set1_epi32(2)), 30)));
+    }
+
+    static M greater(F a, F b) { return _mm_cmpgt_ps(a, b); }
+    static F select(M m, F a, F b) { return _mm_or_ps(_mm_and_ps(m, a), _mm_andnot_ps(m, b)); }
+    static bool any(M m) { return _mm_movemask_ps(m) != 0; }
+    static bool laneSet(M m, int lane) { return (_mm_movemask_ps(m) >> lane) & 1; }
+};
+
+}
+
+void transformSSE2(float* data, size_t count) {
+    detail::transformBlock<VecSSE2>(data, count, transformScalar);
+}
+
+}
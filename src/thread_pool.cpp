@@ -0,0 +1,259 @@
+#include "thread_pool.h"
+#include "metrics.h"
+#include "numa.h"
+#include <algorithm>
+
+namespace {
+
+// The pool and index of the worker running on this thread, if any.
+thread_local const ThreadPool* t_pool = nullptr;
+thread_local unsigned t_worker = 0;
+
+}
+
+ThreadPool::ThreadPool(unsigned num_threads, Affinity affinity) : placement(affinity) {
+    if (num_threads == 0) num_threads = std::thread::hardware_concurrency();
+    if (num_threads == 0) num_threads = 1;
+
+    for (unsigned i = 0; i < num_threads; i++)
+        workers.push_back(std::make_unique<Worker>());
+
+    for (unsigned i = 0; i < num_threads; i++) {
+        threads.emplace_back(&ThreadPool::workerLoop, this, i);
+        if (affinity == Affinity::Spread && numa::pinThread(threads.back(), numa::cpuForWorker(i, num_threads)))
+            pinned++;
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard<std::mutex> lk(sleep_mutex);
+        stopping = true;
+    }
+    sleep_cv.notify_all();
+    for (auto& th : threads) th.join();
+}
+
+std::shared_ptr<ThreadPool> ThreadPool::shared() {
+    static std::shared_ptr<ThreadPool> pool = std::make_shared<ThreadPool>();
+    return pool;
+}
+
+void ThreadPool::parallelFor(size_t begin, size_t end, size_t grain, const RangeFn& fn) {
+    if (end <= begin) return;
+    if (grain == 0) grain = 1;
+
+    // Small batches are cheaper to run inline than to hand to another core.
+    if (end - begin <= grain) {
+        fn(begin, end);
+        return;
+    }
+
+    submit(begin, end, grain, fn).wait();
+}
+
+ThreadPool::Batch ThreadPool::submit(size_t begin, size_t end, size_t grain, RangeFn fn) {
+    auto job = std::make_shared<Job>();
+    job->fn = std::move(fn);
+    job->grain = grain == 0 ? 1 : grain;
+
+    if (end <= begin) {
+        job->done = true;
+        return Batch(this, std::move(job));
+    }
+
+    job->remaining.store(end - begin, std::memory_order_relaxed);
+    enqueue(job.get(), begin, end);
+    return Batch(this, std::move(job));
+}
+
+void ThreadPool::forEachWorker(size_t begin, size_t end, const RangeFn& fn) {
+    if (end <= begin) return;
+
+    auto job = std::make_shared<Job>();
+    job->fn = fn;
+    job->grain = end - begin;  // never split
+    job->remaining.store(end - begin, std::memory_order_relaxed);
+
+    // On one of our own workers, its slice runs here: queued, it would wait
+    // behind the very call that waits for it.
+    size_t self = t_pool == this ? t_worker : size();
+    size_t pieces = std::min<size_t>(size(), end - begin);
+    size_t slice = (end - begin) / pieces;
+    for (size_t p = 0; p < pieces; p++) {
+        size_t start = begin + p * slice;
+        size_t stop = (p == pieces - 1) ? end : start + slice;
+        if (p != self) push(static_cast<unsigned>(p), Task{start, stop, job.get(), true}, false);
+    }
+    // notify_one could wake a worker that isn't allowed to run anything.
+    { std::lock_guard<std::mutex> lk(sleep_mutex); }
+    sleep_cv.notify_all();
+
+    if (self < pieces) {
+        size_t start = begin + self * slice;
+        runTask(t_worker, Task{start, self == pieces - 1 ? end : start + slice, job.get(), true});
+    }
+    Batch(this, std::move(job)).wait();
+}
+
+void ThreadPool::enqueue(Job* job, size_t begin, size_t end) {
+    // Seed every deque with one contiguous slice so all workers start at once;
+    // further splitting happens lazily inside runTask.
+    size_t n = end - begin;
+    size_t pieces = std::min<size_t>(size(), (n + job->grain - 1) / job->grain);
+    size_t slice = n / pieces;
+    for (size_t p = 0; p < pieces; p++) {
+        size_t start = begin + p * slice;
+        size_t stop = (p == pieces - 1) ? end : start + slice;
+        push(static_cast<unsigned>(p), Task{start, stop, job});
+    }
+}
+
+void ThreadPool::help(Job& job) {
+    // Help out instead of blocking; splits go to a rotating deque so that
+    // concurrent callers don't all pile onto worker 0. A worker keeps its own
+    // deque, including slices pinned to it that another caller may be
+    // waiting for.
+    bool on_worker = t_pool == this;
+    unsigned home = on_worker ? t_worker : next_home.fetch_add(1, std::memory_order_relaxed) % size();
+    Task task;
+    while (job.remaining.load(std::memory_order_acquire) != 0 &&
+           ((on_worker && popLocal(home, task)) || steal(home, task)))
+        runTask(home, task);
+
+    std::unique_lock<std::mutex> lk(job.m);
+    job.cv.wait(lk, [&] { return job.done; });
+}
+
+ThreadPool::Batch& ThreadPool::Batch::operator=(Batch&& other) noexcept {
+    if (this != &other) {
+        if (job) pool->help(*job);
+        pool = other.pool;
+        job = std::move(other.job);
+    }
+    return *this;
+}
+
+ThreadPool::Batch::~Batch() {
+    if (job) pool->help(*job);
+}
+
+bool ThreadPool::Batch::ready() const {
+    return !job || job->remaining.load(std::memory_order_acquire) == 0;
+}
+
+void ThreadPool::Batch::wait() {
+    if (!job) return;
+    pool->help(*job);
+    std::exception_ptr error = job->error;
+    job.reset();
+    if (error) std::rethrow_exception(error);
+}
+
+void ThreadPool::workerLoop(unsigned index) {
+    if (metrics::kEnabled) metrics::setThreadName("worker " + std::to_string(index));
+    t_pool = this;
+    t_worker = index;
+    Worker& self = *workers[index];
+
+    Task task;
+    for (;;) {
+        if (popLocal(index, task) || steal(index, task)) {
+            runTask(index, task);
+            continue;
+        }
+
+        std::unique_lock<std::mutex> lk(sleep_mutex);
+        uint64_t idle_start = metrics::nowNs();
+        sleeping.fetch_add(1);
+        // Slices pinned to other workers are no reason to wake up.
+        sleep_cv.wait(lk, [&] { return stopping || queued.load() > 0 || self.pinned_tasks.load() > 0; });
+        sleeping.fetch_sub(1);
+        metrics::add(metrics::Counter::CpuIdleNs, metrics::nowNs() - idle_start);
+        if (stopping && queued.load() == 0 && self.pinned_tasks.load() == 0) return;
+    }
+}
+
+void ThreadPool::push(unsigned index, const Task& task, bool wake) {
+    {
+        std::lock_guard<std::mutex> lk(workers[index]->m);
+        workers[index]->tasks.push_back(task);
+    }
+    if (task.pinned) {
+        workers[index]->pinned_tasks.fetch_add(1);
+    } else {
+        queued.fetch_add(1);
+    }
+
+    // Pairs with the sleeping/queued handshake in workerLoop: taking the
+    // mutex guarantees a worker that just decided to sleep sees the notify.
+    if (wake && sleeping.load() > 0) {
+        { std::lock_guard<std::mutex> lk(sleep_mutex); }
+        sleep_cv.notify_one();
+    }
+}
+
+bool ThreadPool::popLocal(unsigned index, Task& task) {
+    Worker& w = *workers[index];
+    std::lock_guard<std::mutex> lk(w.m);
+    if (w.tasks.empty()) return false;
+    task = w.tasks.back();
+    w.tasks.pop_back();
+    if (task.pinned) {
+        w.pinned_tasks.fetch_sub(1);
+    } else {
+        queued.fetch_sub(1);
+    }
+    return true;
+}
+
+bool ThreadPool::steal(unsigned thief, Task& task) {
+    size_t count = workers.size();
+    for (size_t k = 1; k <= count; k++) {
+        Worker& w = *workers[(thief + k) % count];
+        std::lock_guard<std::mutex> lk(w.m);
+        // Oldest first, passing over slices pinned to this worker.
+        auto it = std::find_if(w.tasks.begin(), w.tasks.end(), [](const Task& t) { return !t.pinned; });
+        if (it == w.tasks.end()) continue;
+        task = *it;
+        w.tasks.erase(it);
+        queued.fetch_sub(1);
+        return true;
+    }
+    return false;
+}
+
+void ThreadPool::runTask(unsigned home, Task task) {
+    Job* job = task.job;
+
+    while (task.end - task.begin > job->grain) {
+        size_t mid = task.begin + (task.end - task.begin) / 2;
+        push(home, Task{mid, task.end, job});
+        task.end = mid;
+    }
+
+    if (!job->failed.load(std::memory_order_relaxed)) {
+        metrics::Scope busy(metrics::Counter::CpuBusyNs, "cpu.range");
+        metrics::add(metrics::Counter::CpuChunks, 1);
+        metrics::add(metrics::Counter::CpuElements, task.end - task.begin);
+        try {
+            job->fn(task.begin, task.end);
+        } catch (...) {
+            std::lock_guard<std::mutex> lk(job->m);
+            if (!job->error) job->error = std::current_exception();
+            job->failed.store(true, std::memory_order_relaxed);
+        }
+    }
+
+    finish(job, task.end - task.begin);
+}
+
+void ThreadPool::finish(Job* job, size_t count) {
+    if (job->remaining.fetch_sub(count, std::memory_order_acq_rel) == count) {
+        // Notify while holding the lock: the waiter may release `job` as
+        // soon as it observes done.
+        std::lock_guard<std::mutex> lk(job->m);
+        job->done = true;
+        job->cv.notify_all();
+    }
+}
@@ -1,16 +1,36 @@
 #include "cpu_compute.h"
 #include "gpu_compute.h"
+#include "hybrid_compute.h"
+#include "thread_pool.h"
+#include "simd_transform.h"
+#include "file_processor.h"
+#include "mapped_file.h"
+#include "numa.h"
+#include "metrics.h"
 #include <gtest/gtest.h>
 #include <vector>
 #include <cmath>
 #include <stdexcept>
 #include <random>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <cstring>
+#include <limits>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <mutex>
+#include <set>
+#include <thread>
 
 class GpuTestWithShader : public ::testing::Test {
 protected:
     std::unique_ptr<ComputeGPU> compute;
     void SetUp() override {
         compute = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
+        compute->setProgramCacheDirectory("");  // keep test runs out of the user's cache
         compute->init("shaders/compute_shader.glsl");
     }
 
@@ -19,6 +39,29 @@ protected:
     }
 };
 
+// Skips instead of failing when no GL context can be created (headless CI
+// without llvmpipe or a display).
+class GpuTestOrSkip : public ::testing::Test {
+protected:
+    std::unique_ptr<ComputeGPU> compute;
+    void SetUp() override {
+        compute = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
+        compute->setProgramCacheDirectory("");
+        try {
+            compute->init("shaders/compute_shader.glsl");
+        } catch (const std::runtime_error& e) {
+            GTEST_SKIP() << "No GL context: " << e.what();
+        }
+    }
+
+    void TearDown() override {
+        compute->shutdown();
+    }
+};
+
+// The streaming tests; same setup.
+class GpuStreamingTest : public GpuTestOrSkip {};
+
 class CpuTest : public ::testing::Test {
 protected:
     std::unique_ptr<ComputeCPU> compute;
@@ -43,6 +86,691 @@ TEST_F(CpuTest, CPUComputeMatchesExpected) {
         EXPECT_FLOAT_EQ(data[i], expected);
 }
 
+// Distance in representable floats between a and b (both finite).
+static int64_t ulpDistance(float a, float b) {
+    int32_t ia, ib;
+    std::memcpy(&ia, &a, sizeof(float));
+    std::memcpy(&ib, &b, sizeof(float));
+    if (ia < 0) ia = INT32_MIN - ia;
+    if (ib < 0) ib = INT32_MIN - ib;
+    return std::llabs(static_cast<int64_t>(ia) - static_cast<int64_t>(ib));
+}
+
+static float referenceTransform(float x) {
+    double d = x;
+    return static_cast<float>(std::sqrt(d) + std::sin(d) * std::cos(d) + std::exp(-d * 0.001));
+}
+
+// Sweeps [0, 2^20] (dense near zero, log-spaced above, plus random points)
+// through every SIMD level this CPU supports and checks the ULP bound
+// documented in simd_transform.h; past 32768 the libm fallback applies.
+TEST_F(CpuTest, SimdAccuracySweep) {
+    std::vector<float> inputs;
+    for (float x = 0.0f; x < 16.0f; x += 1.0f / 1024.0f) inputs.push_back(x);
+    for (float x = 16.0f; x < 1048576.0f; x *= 1.0001f) inputs.push_back(x);
+    std::mt19937 rng(777);
+    std::uniform_real_distribution<float> dist(0.0f, 32768.0f);
+    for (int i = 0; i < 200000; ++i) inputs.push_back(dist(rng));
+    inputs.push_back(32768.0f);
+    inputs.push_back(std::nextafter(32768.0f, 1e9f));
+
+    simd::Level best = simd::detectLevel();
+    for (int l = 0; l <= static_cast<int>(best); ++l) {
+        simd::Level level = static_cast<simd::Level>(l);
+        simd::setLevel(level);
+        ASSERT_EQ(simd::activeLevel(), level);
+
+        std::vector<float> data = inputs;
+        compute->process(data);
+
+        int64_t worst = 0;
+        float worst_x = 0.0f;
+        for (size_t i = 0; i < data.size(); ++i) {
+            int64_t d = ulpDistance(data[i], referenceTransform(inputs[i]));
+            if (d > worst) { worst = d; worst_x = inputs[i]; }
+        }
+        EXPECT_LE(worst, 2) << simd::levelName(level) << " worst at x = " << worst_x;
+    }
+    simd::setLevel(best);
+}
+
+TEST_F(CpuTest, SimdTailMatchesBody) {
+    // Every length up to a few vectors, so each tail size goes through the
+    // padded path; results must not depend on position.
+    for (size_t n = 1; n <= 67; ++n) {
+        std::vector<float> data(n);
+        for (size_t i = 0; i < n; ++i) data[i] = 3.0f + static_cast<float>(i % 7);
+        std::vector<float> single(data);
+        simd::transform(data.data(), n);
+        for (size_t i = 0; i < n; ++i) {
+            simd::transform(&single[i], 1);
+            ASSERT_EQ(data[i], single[i]) << "n = " << n << ", i = " << i;
+        }
+    }
+}
+
+TEST_F(CpuTest, SimdSpecialValues) {
+    std::vector<float> data = {0.0f, -1.0f, std::numeric_limits<float>::infinity(),
+                               std::numeric_limits<float>::quiet_NaN(), 1e30f};
+    compute->process(data);
+    EXPECT_FLOAT_EQ(data[0], 1.0f);
+    EXPECT_TRUE(std::isnan(data[1]));
+    EXPECT_TRUE(std::isnan(data[2]));
+    EXPECT_TRUE(std::isnan(data[3]));
+    EXPECT_FLOAT_EQ(data[4], simd::transformScalar(1e30f));
+}
+
+TEST_F(CpuTest, CustomThreadsAndGrainMatchDefault) {
+    const size_t N = (1 << 16) + 7;
+
+    std::vector<float> expected(N);
+    for (size_t i = 0; i < N; ++i) expected[i] = 1.0f + static_cast<float>(i % 100);
+    std::vector<float> data = expected;
+
+    compute->process(expected);
+
+    ComputeCPU custom(3, 1000);
+    EXPECT_EQ(custom.threadCount(), 3u);
+    EXPECT_EQ(custom.grainSize(), 1000u);
+    custom.process(data);
+
+    for (size_t i = 0; i < N; ++i)
+        EXPECT_EQ(data[i], expected[i]);
+}
+
+TEST_F(CpuTest, ZeroGrainThrows) {
+    EXPECT_THROW(ComputeCPU(2, 0), std::runtime_error);
+    EXPECT_THROW(compute->setGrainSize(0), std::runtime_error);
+}
+
+struct AddOne : kernels::MapOp<AddOne> {
+    static constexpr const char* name = "test_add_one";
+    static constexpr const char* glsl = "x = x + 1.0;";
+    static float apply(float x) { return x + 1.0f; }
+};
+
+static std::vector<float> rampData(size_t n) {
+    std::vector<float> data(n);
+    for (size_t i = 0; i < n; ++i) data[i] = static_cast<float>(i % 1000) * 0.01f;
+    return data;
+}
+
+TEST_F(CpuTest, KernelMapMatchesProcess) {
+    std::vector<float> expected = rampData(100000);
+    std::vector<float> data = expected;
+    compute->process(expected);
+    compute->run(kernels::makeMap<kernels::Transform>(), data);
+    for (size_t i = 0; i < data.size(); ++i)
+        ASSERT_EQ(data[i], expected[i]);
+}
+
+TEST_F(CpuTest, KernelReductionsLeaveInputUntouched) {
+    const std::vector<float> original = rampData(100000);
+    std::vector<float> data = original;
+
+    double sum = 0.0;
+    for (float v : original) sum += v;
+
+    EXPECT_NEAR(compute->run(kernels::makeReduce(kernels::Reduce::Sum), data).value, sum, 1e-6 * sum);
+    EXPECT_EQ(compute->run(kernels::makeReduce(kernels::Reduce::Min), data).value, 0.0);
+    EXPECT_FLOAT_EQ(static_cast<float>(compute->run(kernels::makeReduce(kernels::Reduce::Max), data).value), 9.99f);
+
+    kernels::Result hist = compute->run(kernels::makeReduce(kernels::Reduce::Histogram, {0.0f, 5.0f, 5}), data);
+    ASSERT_EQ(hist.histogram.size(), 5u);
+    uint64_t counted = 0;
+    for (uint64_t c : hist.histogram) counted += c;
+    EXPECT_EQ(counted, 50000u);  // values in [5, 10) fall outside
+    EXPECT_EQ(hist.histogram[0], 10000u);
+
+    // Reduce over a map without writing the mapped values back.
+    kernels::Result max_sq = compute->run(kernels::makeReduce<kernels::Square>(kernels::Reduce::Max), data);
+    EXPECT_FLOAT_EQ(static_cast<float>(max_sq.value), 9.99f * 9.99f);
+
+    EXPECT_EQ(data, original);
+}
+
+TEST_F(CpuTest, FusedMapReduceWritesBack) {
+    std::vector<float> data(5000, 2.0f);
+    kernels::Result r = compute->run(kernels::makeMapReduce<AddOne>(kernels::Reduce::Sum), data);
+    EXPECT_DOUBLE_EQ(r.value, 15000.0);
+    for (float v : data) ASSERT_EQ(v, 3.0f);
+}
+
+TEST_F(CpuTest, StridedSpanTouchesOnlyItsChannel) {
+    // Three interleaved channels; process channel 1 in place.
+    const size_t n = 50000;
+    std::vector<float> interleaved(3 * n);
+    for (size_t i = 0; i < interleaved.size(); ++i) interleaved[i] = static_cast<float>(i % 997) * 0.01f;
+    const std::vector<float> original = interleaved;
+
+    compute->run(kernels::makeMap<AddOne>(), FloatSpan(interleaved.data() + 1, n, 3));
+    for (size_t i = 0; i < interleaved.size(); ++i)
+        ASSERT_EQ(interleaved[i], i % 3 == 1 ? original[i] + 1.0f : original[i]) << i;
+
+    double sum = 0.0;
+    for (size_t i = 0; i < n; ++i) sum += interleaved[3 * i + 2];
+    kernels::Result r = compute->run(kernels::makeReduce(kernels::Reduce::Sum), FloatSpan(interleaved.data() + 2, n, 3));
+    EXPECT_NEAR(r.value, sum, 1e-6 * sum);
+}
+
+TEST_F(CpuTest, SpanOverExternalMemory) {
+    std::unique_ptr<float[]> buffer(new float[4096]);
+    for (size_t i = 0; i < 4096; ++i) buffer[i] = 64.0f;
+    compute->process(FloatSpan(buffer.get(), 4096));
+    float expected = kernels::Transform::apply(64.0f);
+    for (size_t i = 0; i < 4096; ++i) ASSERT_EQ(buffer[i], expected);
+}
+
+TEST(HalfTest, ScalarConversions) {
+    // Every finite half survives the round trip; NaNs stay NaN.
+    for (uint32_t bits = 0; bits <= 0xffff; ++bits) {
+        Half h{static_cast<uint16_t>(bits)};
+        float x = toFloat(h);
+        if (std::isnan(x)) {
+            ASSERT_TRUE(std::isnan(toFloat(toHalf(x)))) << bits;
+            continue;
+        }
+        ASSERT_EQ(toHalf(x).bits, h.bits) << bits;
+    }
+
+    EXPECT_EQ(toHalf(1.0f).bits, 0x3c00);
+    EXPECT_EQ(toHalf(65504.0f).bits, 0x7bff);
+    EXPECT_EQ(toHalf(65519.0f).bits, 0x7bff);
+    EXPECT_EQ(toHalf(65520.0f).bits, 0x7c00);  // rounds past the largest finite half
+    EXPECT_EQ(toHalf(1.0f + 0x1p-11f).bits, 0x3c00);      // tie, to even
+    EXPECT_EQ(toHalf(1.0f + 3 * 0x1p-11f).bits, 0x3c02);  // tie, to even
+    EXPECT_EQ(toHalf(0x1p-24f).bits, 0x0001);  // smallest subnormal
+    EXPECT_EQ(toHalf(0x1p-25f).bits, 0x0000);  // tie, to even (zero)
+    EXPECT_EQ(toHalf(-2.0f).bits, 0xc000);
+    EXPECT_FLOAT_EQ(toFloat(Half{0x3555}), 0.33325195f);
+
+    EXPECT_EQ(toBFloat16(1.0f).bits, 0x3f80);
+    EXPECT_EQ(toBFloat16(1.0f + 0x1p-8f).bits, 0x3f80);      // tie, to even
+    EXPECT_EQ(toBFloat16(1.0f + 3 * 0x1p-8f).bits, 0x3f82);  // tie, to even
+    EXPECT_EQ(toBFloat16(std::numeric_limits<float>::max()).bits, 0x7f80);
+    EXPECT_TRUE(std::isnan(toFloat(toBFloat16(std::numeric_limits<float>::quiet_NaN()))));
+    EXPECT_EQ(toFloat(BFloat16{0x4049}), 3.140625f);
+}
+
+TEST(HalfTest, EveryLevelMatchesScalar) {
+    std::mt19937 rng(7);
+    std::uniform_real_distribution<float> dist(-70000.0f, 70000.0f);
+    std::vector<float> values(1003);  // odd, so each vector width has a tail
+    for (float& v : values) v = dist(rng);
+    const float specials[] = {0.0f, -0.0f, 0x1p-20f, -0x1p-24f, 0x1p-126f, 65504.0f, 65520.0f, 1e30f,
+                              std::numeric_limits<float>::infinity(), std::numeric_limits<float>::quiet_NaN()};
+    std::copy(std::begin(specials), std::end(specials), values.begin());
+    for (size_t i = 20; i < 200; ++i) values[i] *= 1e-8f;  // half subnormals
+
+    std::vector<Half> halves(values.size());
+    std::vector<BFloat16> bf16s(values.size());
+    std::vector<float> widened(values.size());
+
+    simd::Level best = simd::detectLevel();
+    for (int l = 0; l <= static_cast<int>(best); ++l) {
+        simd::Level level = static_cast<simd::Level>(l);
+        simd::setLevel(level);
+
+        fromFloat(values.data(), values.size(), halves.data());
+        toFloat(halves.data(), halves.size(), widened.data());
+        for (size_t i = 0; i < values.size(); ++i) {
+            ASSERT_EQ(halves[i].bits, toHalf(values[i]).bits) << simd::levelName(level) << " x = " << values[i];
+            float expected = toFloat(halves[i]);
+            if (std::isnan(expected)) ASSERT_TRUE(std::isnan(widened[i]));
+            else ASSERT_EQ(widened[i], expected) << simd::levelName(level);
+        }
+
+        fromFloat(values.data(), values.size(), bf16s.data());
+        toFloat(bf16s.data(), bf16s.size(), widened.data());
+        for (size_t i = 0; i < values.size(); ++i) {
+            ASSERT_EQ(bf16s[i].bits, toBFloat16(values[i]).bits) << simd::levelName(level) << " x = " << values[i];
+            float expected = toFloat(bf16s[i]);
+            if (std::isnan(expected)) ASSERT_TRUE(std::isnan(widened[i]));
+            else ASSERT_EQ(widened[i], expected) << simd::levelName(level);
+        }
+    }
+    simd::setLevel(best);
+}
+
+template <class T>
+static std::vector<T> storeAs(const std::vector<float>& values) {
+    std::vector<T> out(values.size());
+    fromFloat(values.data(), values.size(), out.data());
+    return out;
+}
+
+template <class T>
+static std::vector<float> widen(const std::vector<T>& values) {
+    std::vector<float> out(values.size());
+    toFloat(values.data(), values.size(), out.data());
+    return out;
+}
+
+// rel is how far the stored result may be from the float one, relative:
+// half an ulp of T's significand for a single rounding.
+template <class T>
+static void expectStoredWithin(const std::vector<T>& stored, const std::vector<float>& exact, float rel) {
+    ASSERT_EQ(stored.size(), exact.size());
+    std::vector<float> got = widen(stored);
+    for (size_t i = 0; i < got.size(); ++i)
+        ASSERT_NEAR(got[i], exact[i], rel * std::fabs(exact[i])) << i;
+}
+
+template <class T>
+static void checkCpuStorage(ICompute& compute, float rel) {
+    const std::vector<T> stored = storeAs<T>(rampData(100003));
+    std::vector<T> data = stored;
+    // The float computation the 16-bit one must follow: same inputs, rounded once at the end.
+    std::vector<float> exact = widen(data);
+
+    double sum = 0.0;
+    for (float v : exact) sum += v;
+    EXPECT_NEAR(compute.run(kernels::makeReduce(kernels::Reduce::Sum), data).value, sum, 1e-9 * sum);
+    kernels::HistogramSpec spec{0.0f, 10.0f, 7};
+    EXPECT_EQ(compute.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), data).histogram,
+              compute.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), exact).histogram);
+
+    compute.run(kernels::makeMap<kernels::Transform>(), exact);
+    compute.process(StridedSpan<T>(data));
+    expectStoredWithin(data, exact, rel);
+
+    // Every other element of an interleaved buffer.
+    std::vector<T> interleaved(2 * stored.size());
+    for (size_t i = 0; i < interleaved.size(); ++i) interleaved[i] = stored[i / 2];
+    const std::vector<T> before = interleaved;
+    compute.run(kernels::makeMap<kernels::Transform>(), StridedSpan<T>(interleaved.data() + 1, stored.size(), 2));
+    std::vector<T> odd(stored.size());
+    for (size_t i = 0; i < stored.size(); ++i) {
+        ASSERT_EQ(interleaved[2 * i].bits, before[2 * i].bits);
+        odd[i] = interleaved[2 * i + 1];
+    }
+    expectStoredWithin(odd, exact, rel);
+}
+
+TEST_F(CpuTest, HalfStorageWithinRoundingOfFloat) {
+    checkCpuStorage<Half>(*compute, 0x1p-11f);
+    checkCpuStorage<BFloat16>(*compute, 0x1p-8f);
+}
+
+// Empty ranges reduce to +-inf for Min / Max, which EXPECT_NEAR can't compare.
+static void expectSameResult(const kernels::Result& got, const kernels::Result& expected, double rel) {
+    if (got.value != expected.value) {
+        EXPECT_NEAR(got.value, expected.value, rel * std::fabs(expected.value));
+    }
+    EXPECT_EQ(got.histogram, expected.histogram);
+}
+
+TEST_F(CpuTest, RunBatchMatchesSeparateRuns) {
+    const size_t sizes[] = {0, 1, 300, 5000, 0, 17, 40000, 255};
+    std::vector<std::vector<float>> arrays;
+    for (size_t n : sizes) {
+        std::vector<float> data = rampData(n + 3);
+        arrays.emplace_back(data.begin() + 3, data.end());
+    }
+    auto spans = [](std::vector<std::vector<float>>& a) {
+        return std::vector<FloatSpan>(a.begin(), a.end());
+    };
+
+    ComputeCPU small_grain(2, 100);  // ranges that straddle arrays
+    const kernels::Kernel reductions[] = {kernels::makeReduce(kernels::Reduce::Sum),
+                                          kernels::makeReduce(kernels::Reduce::Min),
+                                          kernels::makeReduce<kernels::Square>(kernels::Reduce::Max),
+                                          kernels::makeReduce(kernels::Reduce::Histogram, {0.0f, 10.0f, 7})};
+    for (const kernels::Kernel& kernel : reductions) {
+        std::vector<kernels::Result> batch = small_grain.runBatch(kernel, spans(arrays));
+        ASSERT_EQ(batch.size(), arrays.size());
+        for (size_t a = 0; a < arrays.size(); ++a) {
+            SCOPED_TRACE(kernel.key() + " array " + std::to_string(a));
+            kernels::Result single = compute->run(kernel, arrays[a]);
+            expectSameResult(batch[a], single, 1e-9);
+        }
+    }
+
+    std::vector<std::vector<float>> expected = arrays;
+    for (auto& data : expected) compute->process(data);
+    small_grain.runBatch(kernels::makeMap<kernels::Transform>(), spans(arrays));
+    EXPECT_EQ(arrays, expected);
+}
+
+static void writeFloats(const std::string& path, const std::vector<float>& data) {
+    std::ofstream f(path, std::ios::binary | std::ios::trunc);
+    f.write(reinterpret_cast<const char*>(data.data()), data.size() * sizeof(float));
+}
+
+static std::vector<float> readFloats(const std::string& path) {
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    std::vector<float> data(static_cast<size_t>(f.tellg()) / sizeof(float));
+    f.seekg(0);
+    f.read(reinterpret_cast<char*>(data.data()), data.size() * sizeof(float));
+    return data;
+}
+
+TEST_F(CpuTest, FileProcessingMatchesInMemory) {
+    // Ragged last window: 300000 floats over 64 KB windows.
+    const std::vector<float> original = rampData(300000);
+    std::vector<float> expected = original;
+    compute->process(expected);
+
+    FileOptions options;
+    options.window_bytes = 64 << 10;
+    writeFloats("file_test_in.bin", original);
+
+    FileStats stats = processFile(*compute, "file_test_in.bin", "file_test_out.bin", options);
+    EXPECT_EQ(stats.bytes, original.size() * sizeof(float));
+    EXPECT_EQ(stats.windows, (stats.bytes + options.window_bytes - 1) / options.window_bytes);
+    EXPECT_EQ(readFloats("file_test_out.bin"), expected);
+    EXPECT_EQ(readFloats("file_test_in.bin"), original);
+
+    processFile(*compute, "file_test_in.bin", "", options);
+    EXPECT_EQ(readFloats("file_test_in.bin"), expected);
+
+    double sum = 0.0;
+    for (float v : original) sum += v;
+    writeFloats("file_test_in.bin", original);
+    FileStats reduced = processFile(*compute, kernels::makeReduce(kernels::Reduce::Sum), "file_test_in.bin", "", options);
+    EXPECT_NEAR(reduced.result.value, sum, 1e-6 * sum);
+    EXPECT_THROW(processFile(*compute, kernels::makeReduce(kernels::Reduce::Sum), "file_test_in.bin",
+                             "file_test_out.bin", options),
+                 std::runtime_error);
+    EXPECT_GT(measureReadBandwidthGBs("file_test_in.bin"), 0.0);
+
+    std::remove("file_test_in.bin");
+    std::remove("file_test_out.bin");
+}
+
+TEST(FileTest, RejectsBadInput) {
+    ComputeCPU cpu;
+    EXPECT_THROW(processFile(cpu, "no_such_file.bin"), std::runtime_error);
+
+    std::ofstream("file_test_ragged.bin", std::ios::binary) << "abcde";
+    EXPECT_THROW(processFile(cpu, "file_test_ragged.bin", "file_test_ragged_out.bin"), std::runtime_error);
+    std::remove("file_test_ragged.bin");
+
+    std::ofstream("file_test_empty.bin", std::ios::binary);
+    EXPECT_EQ(processFile(cpu, "file_test_empty.bin").windows, 0u);
+    std::remove("file_test_empty.bin");
+}
+
+TEST_F(CpuTest, SubmitRunsAsynchronously) {
+    std::vector<float> a = rampData(200000);
+    std::vector<float> b = rampData(300000);
+    std::vector<float> expected_a = a;
+    compute->process(expected_a);
+    double sum_b = compute->run(kernels::makeReduce(kernels::Reduce::Sum), b).value;
+
+    Completion first = compute->submit(a);
+    Completion second = compute->submit(kernels::makeReduce(kernels::Reduce::Sum), b);
+    Completion all = whenAll({first, second});
+    while (!all.ready()) std::this_thread::yield();
+    all.wait();
+
+    EXPECT_TRUE(first.ready());
+    EXPECT_EQ(a, expected_a);
+    EXPECT_NEAR(second.get().value, sum_b, 1e-6 * sum_b);
+    EXPECT_NEAR(second.get().value, sum_b, 1e-6 * sum_b);  // repeatable
+}
+
+struct Thrower : kernels::MapOp<Thrower> {
+    static constexpr const char* name = "test_thrower";
+    static constexpr const char* glsl = "";
+    static float apply(float) { throw std::runtime_error("boom"); }
+};
+
+TEST_F(CpuTest, SubmitRethrowsFromEveryWait) {
+    std::vector<float> data(100000, 1.0f);
+    std::vector<float> fine(100000, 1.0f);
+    Completion bad = compute->submit(kernels::makeMap<Thrower>(), data);
+    Completion good = compute->submit(fine);
+    Completion all = whenAll({bad, good});
+    EXPECT_THROW(all.wait(), std::runtime_error);
+    EXPECT_THROW(bad.get(), std::runtime_error);
+    EXPECT_NO_THROW(good.wait());
+    EXPECT_TRUE(Completion().ready());
+    EXPECT_NO_THROW(whenAll({}).wait());
+}
+
+std::atomic<bool> g_gate_open{false};
+
+struct Gated : kernels::MapOp<Gated> {
+    static constexpr const char* name = "test_gated";
+    static constexpr const char* glsl = "";
+    static float apply(float x) {
+        while (!g_gate_open.load()) std::this_thread::yield();
+        return x;
+    }
+};
+
+TEST_F(CpuTest, ReadyDoesNotBlockBehindWait) {
+    g_gate_open = false;
+    std::vector<float> data(10000, 1.0f);
+    Completion job = compute->submit(kernels::makeMap<Gated>(), data);
+    std::atomic<bool> waiting{false};
+    std::thread waiter([&] {
+        waiting = true;
+        job.wait();
+    });
+    while (!waiting.load()) std::this_thread::yield();
+    std::this_thread::sleep_for(std::chrono::milliseconds(10));
+
+    // The job can't finish until the gate opens, so this only returns if
+    // ready() doesn't queue up behind the waiter.
+    EXPECT_FALSE(job.ready());
+    g_gate_open = true;
+    waiter.join();
+    EXPECT_TRUE(job.ready());
+}
+
+TEST(MetricsTest, CountsCpuWorkAndExportsTrace) {
+    if (!metrics::kEnabled) GTEST_SKIP() << "built with PS_ENABLE_METRICS=OFF";
+    ComputeCPU compute(2, 1 << 12);
+    std::vector<float> data(1 << 20, 64.0f);
+
+    metrics::reset();
+    metrics::setTracing(true);
+    compute.process(data);
+    metrics::setTracing(false);
+
+    metrics::Snapshot snap = metrics::snapshot();
+    EXPECT_EQ(snap[metrics::Counter::CpuElements], data.size());
+    EXPECT_GE(snap[metrics::Counter::CpuChunks], data.size() / (1 << 12));
+    EXPECT_GT(snap[metrics::Counter::CpuBusyNs], 0u);
+    EXPECT_GE(snap.cpuImbalance(), 1.0);
+
+    // The caller may run every range itself; allocate() runs a slice on each
+    // worker, so the workers' named blocks show up.
+    compute.allocate(1 << 12);
+    bool saw_worker = false;
+    for (const auto& t : metrics::snapshot().threads) saw_worker = saw_worker || t.name.rfind("worker ", 0) == 0;
+    EXPECT_TRUE(saw_worker);
+
+    std::string trace = metrics::chromeTrace();
+    EXPECT_EQ(trace.rfind("{\"traceEvents\":[", 0), 0u);
+    EXPECT_NE(trace.find("\"name\":\"cpu.range\",\"ph\":\"X\""), std::string::npos);
+    EXPECT_NE(trace.find("\"thread_name\""), std::string::npos);
+
+    // Nothing is traced while tracing is off.
+    metrics::reset();
+    compute.process(data);
+    EXPECT_EQ(metrics::chromeTrace(), "{\"traceEvents\":[]}");
+    EXPECT_EQ(metrics::snapshot()[metrics::Counter::CpuElements], data.size());
+}
+
+TEST(KernelTest, InvalidHistogramThrows) {
+    EXPECT_THROW(kernels::makeReduce(kernels::Reduce::Histogram, {0.0f, 1.0f, 0}), std::runtime_error);
+    EXPECT_THROW(kernels::makeReduce(kernels::Reduce::Histogram, {1.0f, 1.0f, 4}), std::runtime_error);
+}
+
+TEST(HybridTest, FallsBackToCpuWithoutGpu) {
+    ComputeHybrid hybrid("invalid_path.glsl");
+    EXPECT_FALSE(hybrid.gpuAvailable());
+    EXPECT_EQ(hybrid.gpuFraction(), 0.0);
+
+    std::vector<float> expected = rampData(200000);
+    std::vector<float> data = expected;
+    ComputeCPU().process(expected);
+    hybrid.process(data);
+    EXPECT_EQ(data, expected);
+
+    double sum = 0.0;
+    for (float v : data) sum += v;
+    EXPECT_NEAR(hybrid.run(kernels::makeReduce(kernels::Reduce::Sum), data).value, sum, 1e-6 * sum);
+}
+
+// Passes with or without a GL context; with one, both backends take part.
+TEST(HybridTest, SplitMatchesCpuAndAdapts) {
+    HybridOptions options;
+    options.min_gpu_elements = 1 << 12;
+    options.streaming.chunk_elements = 1 << 14;
+    ComputeHybrid hybrid("shaders/compute_shader.glsl", options);
+    ComputeCPU cpu;
+
+    const std::vector<float> original = rampData(1 << 18);
+    for (int rep = 0; rep < 4; ++rep) {
+        std::vector<float> expected = original;
+        std::vector<float> data = original;
+        cpu.process(expected);
+        hybrid.process(data);
+        for (size_t i = 0; i < data.size(); ++i)
+            ASSERT_NEAR(data[i], expected[i], 1e-5f * expected[i]) << "i = " << i;
+    }
+
+    std::vector<float> data = original;
+    kernels::HistogramSpec spec{0.0f, 10.0f, 4};
+    kernels::Result hist = hybrid.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), data);
+    EXPECT_EQ(hist.histogram, cpu.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), data).histogram);
+    EXPECT_FLOAT_EQ(static_cast<float>(hybrid.run(kernels::makeReduce(kernels::Reduce::Max), data).value), 9.99f);
+    EXPECT_EQ(hybrid.run(kernels::makeReduce(kernels::Reduce::Min), data).value, 0.0);
+
+    if (hybrid.gpuAvailable()) {
+        EXPECT_GT(hybrid.cpuRate(), 0.0);
+        EXPECT_GT(hybrid.gpuRate(), 0.0);
+        EXPECT_GE(hybrid.gpuFraction(), 0.02);
+        EXPECT_LE(hybrid.gpuFraction(), 0.98);
+    }
+}
+
+TEST(ThreadPoolTest, SubmitReturnsBeforeCompletion) {
+    ThreadPool pool(2);
+    std::atomic<bool> release{false};
+    std::atomic<size_t> total{0};
+
+    ThreadPool::Batch batch = pool.submit(0, 4096, 64, [&](size_t begin, size_t end) {
+        while (!release.load()) std::this_thread::yield();
+        total += end - begin;
+    });
+    EXPECT_FALSE(batch.ready());
+    release = true;
+    batch.wait();
+    EXPECT_TRUE(batch.ready());
+    EXPECT_EQ(total.load(), 4096u);
+}
+
+TEST(ThreadPoolTest, VisitsEveryIndexOnce) {
+    ThreadPool pool(4);
+    const size_t N = 100003;
+    std::vector<std::atomic<int>> hits(N);
+
+    for (int rep = 0; rep < 20; ++rep) {
+        pool.parallelFor(0, N, 97, [&](size_t begin, size_t end) {
+            for (size_t i = begin; i < end; ++i) hits[i].fetch_add(1);
+        });
+    }
+
+    for (size_t i = 0; i < N; ++i)
+        ASSERT_EQ(hits[i].load(), 20) << "index " << i;
+}
+
+TEST(ThreadPoolTest, RespectsGrainSize) {
+    ThreadPool pool(4);
+    std::atomic<size_t> largest{0};
+
+    pool.parallelFor(10, 50010, 128, [&](size_t begin, size_t end) {
+        size_t len = end - begin;
+        size_t prev = largest.load();
+        while (len > prev && !largest.compare_exchange_weak(prev, len)) {}
+    });
+
+    EXPECT_LE(largest.load(), 128u);
+}
+
+TEST(ThreadPoolTest, RethrowsWorkerException) {
+    ThreadPool pool(2);
+    EXPECT_THROW(pool.parallelFor(0, 10000, 10, [](size_t begin, size_t) {
+        if (begin >= 5000) throw std::runtime_error("boom");
+    }), std::runtime_error);
+
+    // The pool stays usable after a failed batch.
+    std::atomic<size_t> total{0};
+    pool.parallelFor(0, 10000, 10, [&](size_t begin, size_t end) { total += end - begin; });
+    EXPECT_EQ(total.load(), 10000u);
+}
+
+TEST(ThreadPoolTest, ForEachWorkerRunsOneSliceOnEachWorker) {
+    ThreadPool pool(4);
+    std::mutex m;
+    std::vector<std::pair<size_t, size_t>> slices;
+    std::set<std::thread::id> ids;
+    for (int rep = 0; rep < 10; ++rep) {
+        slices.clear();
+        ids.clear();
+        pool.forEachWorker(0, 1003, [&](size_t begin, size_t end) {
+            std::lock_guard<std::mutex> lk(m);
+            slices.emplace_back(begin, end);
+            ids.insert(std::this_thread::get_id());
+        });
+        ASSERT_EQ(slices.size(), 4u);
+        ASSERT_EQ(ids.size(), 4u);
+        ASSERT_EQ(ids.count(std::this_thread::get_id()), 0u);
+        size_t covered = 0;
+        for (auto& s : slices) covered += s.second - s.first;
+        ASSERT_EQ(covered, 1003u);
+    }
+
+    // Fewer elements than workers: one element each, no empty slices.
+    std::atomic<size_t> calls{0};
+    pool.forEachWorker(0, 2, [&](size_t begin, size_t end) { EXPECT_EQ(end - begin, 1u); calls++; });
+    EXPECT_EQ(calls.load(), 2u);
+}
+
+TEST(ThreadPoolTest, ForEachWorkerFromInsideThePool) {
+    // Each worker runs its own slice inline and the other's pinned slice
+    // while it waits, so nested calls from every worker at once finish.
+    ThreadPool pool(2);
+    std::atomic<size_t> total{0};
+    for (int rep = 0; rep < 20; ++rep) {
+        pool.parallelFor(0, 2, 1, [&](size_t, size_t) {
+            pool.forEachWorker(0, 100, [&](size_t begin, size_t end) { total += end - begin; });
+        });
+    }
+    EXPECT_EQ(total.load(), 20u * 2u * 100u);
+}
+
+TEST(NumaTest, TopologyAndPinnedPool) {
+    const numa::Topology& topo = numa::topology();
+    ASSERT_GE(topo.nodes(), 1u);
+    ASSERT_GE(topo.cpus(), 1u);
+
+    // Workers fill nodes in order, each on a CPU of the node it reports.
+    unsigned previous = 0;
+    for (unsigned i = 0; i < 2 * topo.cpus(); ++i) {
+        unsigned node = numa::nodeForWorker(i, 2 * topo.cpus());
+        const auto& cpus = topo.node_cpus[node];
+        EXPECT_GE(node, previous);
+        EXPECT_NE(std::find(cpus.begin(), cpus.end(), numa::cpuForWorker(i, 2 * topo.cpus())), cpus.end());
+        previous = node;
+    }
+
+    auto pool = std::make_shared<ThreadPool>(4, ThreadPool::Affinity::Spread);
+    EXPECT_LE(pool->pinnedWorkers(), 4u);
+    ComputeCPU compute(pool, 1 << 10);
+    FloatBuffer data = compute.allocate(1 << 20, 64.0f);
+    ASSERT_EQ(data.size(), size_t(1) << 20);
+    EXPECT_EQ(reinterpret_cast<uintptr_t>(data.data()) % 64, 0u);
+    compute.process(FloatSpan(data));
+    float expected = kernels::Transform::apply(64.0f);
+    for (float v : data) ASSERT_EQ(v, expected);
+}
+
 TEST(GpuTestWithoutShader, InvalidShaderPath) {
     std::unique_ptr<ComputeGPU> compute = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
     EXPECT_THROW(compute->init("invalid_path.glsl"), std::runtime_error);
@@ -66,4 +794,543 @@ TEST_F(GpuTestWithShader, LargeDataSet) {
     
     for (size_t i = 0; i < data.size(); ++i)
         EXPECT_FLOAT_EQ(data[i], expected);
-}
\ No newline at end of file
+}
+
+TEST_F(GpuTestWithShader, KernelsMatchCpu) {
+    ComputeCPU cpu;
+    const std::vector<float> original = rampData(300000);
+
+    std::vector<float> gpu_data = original;
+    std::vector<float> cpu_data = original;
+    compute->run(kernels::makeMap<AddOne>(), gpu_data);
+    cpu.run(kernels::makeMap<AddOne>(), cpu_data);
+    for (size_t i = 0; i < gpu_data.size(); ++i)
+        ASSERT_FLOAT_EQ(gpu_data[i], cpu_data[i]);
+
+    gpu_data = original;
+    cpu_data = original;
+    compute->run(kernels::makeMap<kernels::Transform>(), gpu_data);
+    cpu.run(kernels::makeMap<kernels::Transform>(), cpu_data);
+    for (size_t i = 0; i < gpu_data.size(); ++i)
+        ASSERT_NEAR(gpu_data[i], cpu_data[i], 1e-5f * cpu_data[i]);
+
+    gpu_data = original;
+    double sum = cpu.run(kernels::makeReduce(kernels::Reduce::Sum), gpu_data).value;
+    EXPECT_NEAR(compute->run(kernels::makeReduce(kernels::Reduce::Sum), gpu_data).value, sum, 1e-5 * sum);
+    EXPECT_EQ(compute->run(kernels::makeReduce(kernels::Reduce::Min), gpu_data).value, 0.0);
+    EXPECT_FLOAT_EQ(static_cast<float>(compute->run(kernels::makeReduce(kernels::Reduce::Max), gpu_data).value), 9.99f);
+
+    kernels::HistogramSpec spec{0.0f, 10.0f, 7};
+    kernels::Result gpu_hist = compute->run(kernels::makeReduce(kernels::Reduce::Histogram, spec), gpu_data);
+    kernels::Result cpu_hist = cpu.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), gpu_data);
+    EXPECT_EQ(gpu_hist.histogram, cpu_hist.histogram);
+    EXPECT_EQ(gpu_data, original);
+
+    kernels::Result fused = compute->run(kernels::makeMapReduce<AddOne>(kernels::Reduce::Sum), gpu_data);
+    EXPECT_NEAR(fused.value, sum + original.size(), 1e-5 * sum);
+    EXPECT_FLOAT_EQ(gpu_data[1], original[1] + 1.0f);
+}
+
+template <class T>
+static void checkGpuStorage(ComputeGPU& gpu, float rel) {
+    ComputeCPU cpu;
+    // Odd, so the last packed word holds one element and one of padding.
+    const std::vector<float> original = rampData(300001);
+    const std::vector<T> stored = storeAs<T>(original);
+
+    std::vector<T> gpu_data = stored;
+    std::vector<T> cpu_data = stored;
+    double sum = cpu.run(kernels::makeReduce(kernels::Reduce::Sum), cpu_data).value;
+    EXPECT_NEAR(gpu.run(kernels::makeReduce(kernels::Reduce::Sum), gpu_data).value, sum, 1e-5 * sum);
+    EXPECT_EQ(gpu.run(kernels::makeReduce(kernels::Reduce::Min), gpu_data).value,
+              cpu.run(kernels::makeReduce(kernels::Reduce::Min), cpu_data).value);
+    EXPECT_EQ(gpu.run(kernels::makeReduce(kernels::Reduce::Max), gpu_data).value,
+              cpu.run(kernels::makeReduce(kernels::Reduce::Max), cpu_data).value);
+    kernels::HistogramSpec spec{0.0f, 10.0f, 7};
+    EXPECT_EQ(gpu.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), gpu_data).histogram,
+              cpu.run(kernels::makeReduce(kernels::Reduce::Histogram, spec), cpu_data).histogram);
+
+    // The shader's float result may land on the other side of a rounding
+    // boundary than the CPU's: allow one ulp of T.
+    gpu.process(StridedSpan<T>(gpu_data));
+    cpu.process(StridedSpan<T>(cpu_data));
+    expectStoredWithin(gpu_data, widen(cpu_data), 2 * rel);
+
+    gpu_data = stored;
+    kernels::Result fused = gpu.run(kernels::makeMapReduce<AddOne>(kernels::Reduce::Sum), gpu_data);
+    std::vector<float> plus_one = widen(stored);
+    for (float& v : plus_one) v += 1.0f;
+    expectStoredWithin(gpu_data, plus_one, rel);
+    EXPECT_NEAR(fused.value, sum + original.size(), 1e-5 * sum);
+
+    std::vector<T> strided(3 * stored.size(), T{0});
+    for (size_t i = 0; i < stored.size(); ++i) strided[3 * i + 2] = stored[i];
+    gpu.run(kernels::makeMap<AddOne>(), StridedSpan<T>(strided.data() + 2, stored.size(), 3));
+    std::vector<T> channel(stored.size());
+    for (size_t i = 0; i < stored.size(); ++i) {
+        ASSERT_EQ(strided[3 * i].bits, 0);
+        channel[i] = strided[3 * i + 2];
+    }
+    expectStoredWithin(channel, plus_one, rel);
+}
+
+TEST_F(GpuTestOrSkip, HalfStorageMatchesCpu) {
+    checkGpuStorage<Half>(*compute, 0x1p-11f);
+    checkGpuStorage<BFloat16>(*compute, 0x1p-8f);
+
+    // Float data still goes through the float program afterwards.
+    std::vector<float> data(1000, 64.0f);
+    compute->process(data);
+    EXPECT_NEAR(data[999], kernels::Transform::apply(64.0f), 1e-5f);
+}
+
+TEST_F(GpuTestOrSkip, RunBatchMatchesCpu) {
+    ComputeCPU cpu;
+    // Empty arrays, exact workgroups, one past, and one big enough for many.
+    const size_t sizes[] = {0, 1, 255, 256, 257, 0, 1000, 70000, 3};
+    std::vector<std::vector<float>> arrays;
+    for (size_t i = 0; i < std::size(sizes); ++i) {
+        std::vector<float> data(sizes[i]);
+        for (size_t j = 0; j < data.size(); ++j) data[j] = static_cast<float>((j * 7 + i) % 1000) * 0.01f;
+        arrays.push_back(std::move(data));
+    }
+    std::vector<FloatSpan> spans(arrays.begin(), arrays.end());
+
+    const kernels::Kernel reductions[] = {kernels::makeReduce(kernels::Reduce::Sum),
+                                          kernels::makeReduce(kernels::Reduce::Min),
+                                          kernels::makeReduce<kernels::Square>(kernels::Reduce::Max),
+                                          kernels::makeReduce(kernels::Reduce::Histogram, {0.0f, 10.0f, 7})};
+    for (const kernels::Kernel& kernel : reductions) {
+        std::vector<kernels::Result> gpu_results = compute->runBatch(kernel, spans);
+        std::vector<kernels::Result> cpu_results = cpu.runBatch(kernel, spans);
+        ASSERT_EQ(gpu_results.size(), arrays.size());
+        for (size_t a = 0; a < arrays.size(); ++a) {
+            SCOPED_TRACE(kernel.key() + " array " + std::to_string(a));
+            expectSameResult(gpu_results[a], cpu_results[a], 1e-5);
+        }
+    }
+
+    std::vector<std::vector<float>> expected = arrays;
+    cpu.runBatch(kernels::makeMapReduce<AddOne>(kernels::Reduce::Sum), std::vector<FloatSpan>(expected.begin(), expected.end()));
+    std::vector<kernels::Result> fused = compute->runBatch(kernels::makeMapReduce<AddOne>(kernels::Reduce::Sum), spans);
+    EXPECT_EQ(arrays, expected);
+    EXPECT_DOUBLE_EQ(fused[0].value, 0.0);
+    EXPECT_FLOAT_EQ(static_cast<float>(fused[1].value), arrays[1][0]);
+    EXPECT_TRUE(compute->runBatch(kernels::makeReduce(kernels::Reduce::Sum), {}).empty());
+}
+
+TEST_F(GpuStreamingTest, MatchesSingleShotForEveryChunkLayout) {
+    const std::vector<float> original = rampData(100000);
+    std::vector<float> expected = original;
+    compute->process(expected);
+
+    // Exact multiple, ragged last chunk, more slots than chunks, one chunk.
+    const size_t chunk_sizes[] = {25000, 30000, 70000, 1000000};
+    for (unsigned slots = 2; slots <= 3; ++slots) {
+        for (size_t chunk : chunk_sizes) {
+            std::vector<float> data = original;
+            StreamingOptions options;
+            options.chunk_elements = chunk;
+            options.slots = slots;
+            StreamingStats stats = compute->processStreaming(data, options);
+
+            EXPECT_EQ(stats.chunks, (original.size() + chunk - 1) / chunk);
+            EXPECT_EQ(stats.bytes, original.size() * sizeof(float));
+            EXPECT_GT(stats.throughputGBs(), 0.0);
+            for (size_t i = 0; i < data.size(); ++i)
+                ASSERT_EQ(data[i], expected[i]) << "slots " << slots << " chunk " << chunk << " i " << i;
+        }
+    }
+}
+
+TEST_F(GpuStreamingTest, StreamsMapKernels) {
+    std::vector<float> data = rampData(50000);
+    std::vector<float> expected = data;
+    for (float& v : expected) v = v * v;
+
+    StreamingOptions options;
+    options.chunk_elements = 4096;
+    compute->processStreaming(kernels::makeMap<kernels::Square>(), data, options);
+    for (size_t i = 0; i < data.size(); ++i)
+        ASSERT_FLOAT_EQ(data[i], expected[i]);
+
+    EXPECT_THROW(compute->processStreaming(kernels::makeReduce(kernels::Reduce::Sum), data, options),
+                 std::runtime_error);
+    options.slots = 1;
+    EXPECT_THROW(compute->processStreaming(data, options), std::runtime_error);
+}
+
+TEST_F(GpuStreamingTest, StridedSpansMatchCpu) {
+    ComputeCPU cpu;
+    const size_t n = 40000;
+    std::vector<float> interleaved(2 * n);
+    for (size_t i = 0; i < interleaved.size(); ++i) interleaved[i] = static_cast<float>(i % 1000) * 0.01f;
+    std::vector<float> expected = interleaved;
+    cpu.process(FloatSpan(expected.data(), n, 2));
+
+    std::vector<float> data = interleaved;
+    compute->process(FloatSpan(data.data(), n, 2));
+    for (size_t i = 0; i < data.size(); ++i)
+        ASSERT_NEAR(data[i], expected[i], 1e-5f * expected[i]) << i;
+
+    data = interleaved;
+    StreamingOptions options;
+    options.chunk_elements = 8192;
+    compute->processStreaming(FloatSpan(data.data() + 1, n, 2), options);
+    for (size_t i = 0; i < n; ++i) {
+        ASSERT_EQ(data[2 * i], interleaved[2 * i]);
+        ASSERT_NEAR(data[2 * i + 1], kernels::Transform::apply(interleaved[2 * i + 1]), 1e-5f * data[2 * i + 1]);
+    }
+}
+
+TEST_F(GpuTestOrSkip, MappedResultsAvoidTheCopy) {
+    std::vector<float> data(10000, 64.0f);
+    compute->uploadData(data);
+    compute->processDataGPU_NoTransfer(data.size(), false);
+
+    float expected = std::sqrt(64.0f) + std::sin(64.0f) * std::cos(64.0f) + std::exp(-64.0f * 0.001f);
+    {
+        ComputeGPU::MappedView view = compute->mapResults(data.size());
+        ASSERT_EQ(view.size(), data.size());
+        for (float v : view) ASSERT_FLOAT_EQ(v, expected);
+
+        // The buffer belongs to the view until it goes away.
+        EXPECT_THROW(compute->uploadData(data), std::runtime_error);
+        EXPECT_THROW(compute->downloadData(data), std::runtime_error);
+        EXPECT_THROW(compute->mapResults(data.size()), std::runtime_error);
+
+        ComputeGPU::MappedView moved = std::move(view);
+        EXPECT_FLOAT_EQ(moved[9999], expected);
+    }
+
+    EXPECT_THROW(compute->mapResults(data.size() + 1), std::runtime_error);
+    compute->downloadData(data);
+    for (float v : data) ASSERT_FLOAT_EQ(v, expected);
+}
+
+TEST_F(GpuTestOrSkip, ManyJobsInFlight) {
+    ComputeCPU cpu;
+    const std::vector<float> original = rampData(100000);
+    std::vector<float> expected = original;
+    cpu.run(kernels::makeMap<AddOne>(), expected);
+    std::vector<float> copy = original;
+    double sum = cpu.run(kernels::makeReduce(kernels::Reduce::Sum), copy).value;
+
+    std::vector<std::vector<float>> batches(4, original);
+    std::vector<Completion> maps;
+    for (auto& batch : batches) maps.push_back(compute->submit(kernels::makeMap<AddOne>(), batch));
+    std::vector<float> reduced = original;
+    Completion total = compute->submit(kernels::makeReduce(kernels::Reduce::Sum), reduced);
+    // A handle dropped without waiting still gets its results written back.
+    std::vector<float> dropped = original;
+    compute->submit(kernels::makeMap<AddOne>(), dropped);
+
+    Completion all = whenAll(maps);
+    while (!all.ready()) std::this_thread::yield();
+    for (const auto& batch : batches) ASSERT_EQ(batch, expected);
+    EXPECT_NEAR(total.get().value, sum, 1e-5 * sum);
+    EXPECT_EQ(reduced, original);
+
+    Completion fence = compute->submit(FloatSpan());
+    EXPECT_TRUE(fence.ready());
+    compute->shutdown();
+    for (size_t i = 0; i < dropped.size(); ++i) ASSERT_FLOAT_EQ(dropped[i], expected[i]);
+}
+
+TEST_F(GpuTestOrSkip, ReadyDoesNotQueueBehindOtherCommands) {
+    std::vector<float> data = rampData(10000);
+    Completion job = compute->submit(kernels::makeReduce(kernels::Reduce::Sum), data);
+
+    // Hold the submission thread; ready() must answer from the job's flag
+    // rather than wait its turn.
+    std::atomic<bool> busy{false};
+    std::thread blocker([&] {
+        compute->device().call([&] {
+            busy = true;
+            std::this_thread::sleep_for(std::chrono::milliseconds(500));
+        });
+    });
+    while (!busy.load()) std::this_thread::yield();
+    auto start = std::chrono::steady_clock::now();
+    job.ready();
+    EXPECT_LT(std::chrono::steady_clock::now() - start, std::chrono::milliseconds(250));
+    blocker.join();
+
+    // Finished by the device without anyone waiting.
+    while (!job.ready()) std::this_thread::yield();
+    double sum = 0.0;
+    for (float v : data) sum += v;
+    EXPECT_NEAR(job.get().value, sum, 1e-5 * sum);
+}
+
+TEST_F(GpuTestOrSkip, MetricsCountTransfersAndReallocations) {
+    if (!metrics::kEnabled) GTEST_SKIP() << "built with PS_ENABLE_METRICS=OFF";
+    std::vector<float> small(1000, 64.0f);
+    std::vector<float> large(5000, 64.0f);
+    std::vector<float> huge(1 << 16, 64.0f);
+
+    metrics::reset();
+    compute->process(small);
+    compute->process(small);
+    compute->process(large);  // still fits the smallest pooled buffer
+    EXPECT_EQ(metrics::snapshot()[metrics::Counter::GpuBufferReallocs], 1u);
+    compute->process(huge);
+    compute->process(small);  // keeps the bigger buffer
+
+    metrics::Snapshot snap = metrics::snapshot();
+    EXPECT_EQ(snap[metrics::Counter::GpuBufferReallocs], 2u);
+    EXPECT_EQ(snap[metrics::Counter::GpuUploadBytes],
+              (3 * small.size() + large.size() + huge.size()) * sizeof(float));
+    EXPECT_EQ(snap[metrics::Counter::GpuDownloadBytes], snap[metrics::Counter::GpuUploadBytes]);
+    EXPECT_GT(snap[metrics::Counter::GpuUploadNs], 0u);
+    EXPECT_GT(snap[metrics::Counter::GpuDispatchNs], 0u);
+    EXPECT_GT(snap[metrics::Counter::GpuSyncNs], 0u);
+    EXPECT_GT(snap[metrics::Counter::GpuMapNs], 0u);
+}
+
+TEST_F(GpuTestOrSkip, JobsReusePooledBuffers) {
+    ComputeCPU cpu;
+    std::vector<float> expected = rampData(32000);
+    const std::vector<float> original = expected;
+    cpu.process(expected);
+
+    // 64-128 KB: every job fits the same pooled capacity.
+    std::vector<float> data = original;
+    compute->submit(data).wait();
+    size_t allocated = compute->bufferPoolStats().allocated;
+    for (size_t n : {20000, 17000, 32000, 24000, 16500}) {
+        data.assign(original.begin(), original.begin() + n);
+        compute->submit(data).wait();
+        for (size_t i = 0; i < n; ++i) ASSERT_FLOAT_EQ(data[i], expected[i]);
+    }
+    BufferPool::Stats stats = compute->bufferPoolStats();
+    EXPECT_EQ(stats.allocated, allocated);
+    EXPECT_GE(stats.reused, 5u);
+    EXPECT_GT(stats.idle_bytes, 0u);
+}
+
+TEST(BufferPoolTest, BucketsBoundTheOverhead) {
+    const size_t MB = size_t(1) << 20;
+    EXPECT_EQ(BufferPool::bucketFor(0), BufferPool::kMinBytes);
+    EXPECT_EQ(BufferPool::bucketFor(100 << 10), size_t(128) << 10);
+    EXPECT_EQ(BufferPool::bucketFor(64 * MB), 64 * MB);
+    EXPECT_EQ(BufferPool::bucketFor(64 * MB + 1), 72 * MB);
+    EXPECT_EQ(BufferPool::bucketFor(1024 * MB), 1024 * MB);
+    EXPECT_EQ(BufferPool::bucketFor(1024 * MB + 1), 1152 * MB);
+
+    for (size_t bytes = 1; bytes < (size_t(8) << 30); bytes = bytes * 3 / 2 + 1) {
+        size_t capacity = BufferPool::bucketFor(bytes);
+        ASSERT_GE(capacity, bytes);
+        if (bytes > BufferPool::kFineBytes) {
+            ASSERT_LE(capacity, bytes + bytes / 8) << bytes;
+        }
+        ASSERT_EQ(BufferPool::bucketFor(capacity), capacity) << bytes;  // buckets are stable
+    }
+}
+
+// Instances share one device; each keeps working when others go away, and
+// several threads can drive the GPU at once.
+TEST(GpuDeviceTest, InstancesShareOneDevice) {
+    ComputeCPU cpu;
+    const std::vector<float> original = rampData(50000);
+    std::vector<float> expected = original;
+    cpu.process(expected);
+    auto check = [&](ComputeGPU& gpu) {
+        std::vector<float> data = original;
+        gpu.process(data);
+        for (size_t i = 0; i < data.size(); ++i) ASSERT_FLOAT_EQ(data[i], expected[i]);
+    };
+
+    auto first = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
+    first->setProgramCacheDirectory("");
+    try {
+        first->init("shaders/compute_shader.glsl");
+    } catch (const std::runtime_error& e) {
+        GTEST_SKIP() << "No GL context: " << e.what();
+    }
+    ComputeGPU second("shaders/compute_shader.glsl");
+    second.setProgramCacheDirectory("");
+    second.init("shaders/compute_shader.glsl");
+    EXPECT_EQ(&first->device(), &second.device());
+    EXPECT_EQ(second.startup().context_ms, 0.0);
+
+    check(*first);
+    check(second);
+    first.reset();
+    check(second);
+
+    std::vector<std::thread> threads;
+    std::atomic<int> failures{0};
+    for (int t = 0; t < 4; ++t) {
+        threads.emplace_back([&, t] {
+            ComputeGPU gpu("shaders/compute_shader.glsl");
+            gpu.setProgramCacheDirectory("");
+            gpu.init("shaders/compute_shader.glsl");
+            for (int round = 0; round < 5; ++round) {
+                std::vector<float> data(original.begin() + t * 1000, original.end());
+                if (round % 2) {
+                    gpu.process(data);
+                } else {
+                    gpu.submit(data).wait();
+                }
+                for (size_t i = 0; i < data.size(); ++i) {
+                    float want = expected[i + t * 1000];
+                    if (std::abs(data[i] - want) > 1e-6f * std::abs(want)) {
+                        failures++;
+                        break;
+                    }
+                }
+            }
+        });
+    }
+    for (auto& thread : threads) thread.join();
+    EXPECT_EQ(failures.load(), 0);
+    check(second);
+}
+
+// Different cache directories still share the one device, and either
+// instance keeps working after the other is gone.
+TEST(GpuDeviceTest, CacheDirectoriesShareTheDevice) {
+    namespace fs = std::filesystem;
+    const std::string dir = ::testing::TempDir() + "ps_device_cache_test";
+    fs::remove_all(dir);
+
+    ComputeCPU cpu;
+    const std::vector<float> original = rampData(20000);
+    std::vector<float> expected = original;
+    cpu.process(expected);
+    auto check = [&](ComputeGPU& gpu) {
+        std::vector<float> data = original;
+        gpu.process(data);
+        for (size_t i = 0; i < data.size(); ++i) ASSERT_FLOAT_EQ(data[i], expected[i]);
+    };
+    auto make = [](const std::string& cache) {
+        auto gpu = std::make_unique<ComputeGPU>("shaders/compute_shader.glsl");
+        gpu->setProgramCacheDirectory(cache);
+        gpu->init("shaders/compute_shader.glsl");
+        return gpu;
+    };
+
+    for (int order = 0; order < 2; ++order) {
+        std::unique_ptr<ComputeGPU> memory_only;
+        try {
+            memory_only = make("");
+        } catch (const std::runtime_error& e) {
+            GTEST_SKIP() << "No GL context: " << e.what();
+        }
+        std::unique_ptr<ComputeGPU> on_disk = make(dir);
+        EXPECT_EQ(&memory_only->device(), &on_disk->device());
+        check(*memory_only);
+        check(*on_disk);
+
+        if (order == 0) {
+            memory_only.reset();
+            check(*on_disk);
+        } else {
+            on_disk.reset();
+            check(*memory_only);
+            // Its directory's programs went with it; a new user starts over.
+            on_disk = make(dir);
+            EXPECT_EQ(on_disk->programCacheStats().reused, 0u);
+            check(*on_disk);
+        }
+    }
+    fs::remove_all(dir);
+}
+
+// Contexts in turn over one cache directory: compile and store, load the
+// stored binaries, then recompile what a misnamed or corrupted file holds.
+TEST(ProgramCacheTest, BinariesAreReusedAcrossContexts) {
+    namespace fs = std::filesystem;
+    const std::string dir = ::testing::TempDir() + "ps_program_cache_test";
+    fs::remove_all(dir);
+
+    ComputeCPU cpu;
+    const std::vector<float> original = rampData(10000);
+    std::vector<float> expected = original;
+    cpu.process(expected);
+    std::vector<float> copy = original;
+    double sum = cpu.run(kernels::makeReduce(kernels::Reduce::Sum), copy).value;
+
+    auto runBoth = [&](ComputeGPU& gpu) {
+        std::vector<float> data = original;
+        gpu.process(data);
+        for (size_t i = 0; i < data.size(); ++i) ASSERT_NEAR(data[i], expected[i], 1e-5f * std::abs(expected[i]));
+        std::vector<float> reduced = original;
+        EXPECT_NEAR(gpu.run(kernels::makeReduce(kernels::Reduce::Sum), reduced).value, sum, 1e-5 * sum);
+    };
+
+    {
+        ComputeGPU gpu("shaders/compute_shader.glsl");
+        gpu.setProgramCacheDirectory(dir);
+        try {
+            gpu.init("shaders/compute_shader.glsl");
+        } catch (const std::runtime_error& e) {
+            GTEST_SKIP() << "No GL context: " << e.what();
+        }
+        EXPECT_GT(gpu.startup().context_ms, 0.0);
+        EXPECT_FALSE(gpu.startup().program_from_disk);
+        runBoth(gpu);
+        ProgramCache::Stats stats = gpu.programCacheStats();
+        EXPECT_EQ(stats.compiled, 2u);
+        EXPECT_EQ(stats.loaded, 0u);
+        if (stats.stored == 0) GTEST_SKIP() << "Driver exposes no program binary formats";
+        EXPECT_EQ(stats.stored, 2u);
+    }
+
+    {
+        ComputeGPU gpu("shaders/compute_shader.glsl");
+        gpu.setProgramCacheDirectory(dir);
+        gpu.init("shaders/compute_shader.glsl");
+        EXPECT_TRUE(gpu.startup().program_from_disk);
+        runBoth(gpu);
+        ProgramCache::Stats stats = gpu.programCacheStats();
+        EXPECT_EQ(stats.compiled, 0u);
+        EXPECT_EQ(stats.loaded, 2u);
+    }
+
+    // A binary copied under another program's name (as a hash collision
+    // would leave it) doesn't match that program's key and is ignored.
+    std::vector<fs::path> files;
+    for (const auto& entry : fs::directory_iterator(dir)) files.push_back(entry.path());
+    ASSERT_EQ(files.size(), 2u);
+    fs::copy_file(files[0], files[1], fs::copy_options::overwrite_existing);
+    {
+        ComputeGPU gpu("shaders/compute_shader.glsl");
+        gpu.setProgramCacheDirectory(dir);
+        gpu.init("shaders/compute_shader.glsl");
+        runBoth(gpu);
+        ProgramCache::Stats stats = gpu.programCacheStats();
+        EXPECT_EQ(stats.loaded, 1u);
+        EXPECT_EQ(stats.compiled, 1u);
+    }
+
+    // Same header and key, garbage binary: the driver rejects it and it is
+    // rebuilt. The header is magic, format, length, key length.
+    for (const fs::path& path : files) {
+        std::string contents;
+        {
+            std::ifstream file(path, std::ios::binary);
+            contents.assign(std::istreambuf_iterator<char>(file), std::istreambuf_iterator<char>());
+        }
+        uint32_t header[4];
+        ASSERT_GE(contents.size(), sizeof(header));
+        std::memcpy(header, contents.data(), sizeof(header));
+        header[2] = 64;
+        std::ofstream file(path, std::ios::binary | std::ios::trunc);
+        file.write(reinterpret_cast<const char*>(header), sizeof(header));
+        file.write(contents.data() + sizeof(header), header[3]);
+        file.write(std::string(64, 'x').data(), 64);
+    }
+    {
+        ComputeGPU gpu("shaders/compute_shader.glsl");
+        gpu.setProgramCacheDirectory(dir);
+        gpu.init("shaders/compute_shader.glsl");
+        EXPECT_FALSE(gpu.startup().program_from_disk);
+        runBoth(gpu);
+        ProgramCache::Stats stats = gpu.programCacheStats();
+        EXPECT_EQ(stats.compiled, 2u);
+        EXPECT_EQ(stats.stored, 2u);
+    }
+    fs::remove_all(dir);
+}